@@ -0,0 +1,274 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#include <k4a/k4a.hpp>
+
+#include "capture.hpp"
+#include "rvl.hpp"
+#include "jpeg_encode.hpp"
+#include "motion.hpp"
+
+// Micro-benchmarks for the per-frame kernels run by process_capture, at every color resolution and depth mode
+// Inputs are the synthetic source's patterns, so results are repeatable without a device. Throughput is reported
+// against the uncompressed frame size (BGRA for color, 16-bit for IR) so stages are comparable across resolutions.
+
+struct BenchResult {
+    std::string stage;
+    std::string resolution;
+    int width;
+    int height;
+    uint64_t iterations;
+    double ns_per_frame;
+};
+
+// Keeps results observable so the compiler cannot drop the benchmarked work
+static volatile uint8_t bench_sink = 0;
+
+static void print_usage(const char* program){
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --csv <file>          Also write results as CSV to <file>\n"
+              << "  --min-time <seconds>  Minimum measured time per repeat (default: 0.2)\n"
+              << "  --repeats <n>         Repeats per stage; the median is reported (default: 5)\n"
+              << "  --filter <text>       Only run stages whose name contains <text>\n"
+              << std::flush;
+}
+
+// Run fn in batches until min_time has elapsed, repeats times, and return the median ns per call
+static BenchResult run_stage(const std::string& stage, const std::string& resolution, const int width, const int height,
+                             const double min_time_sec, const int repeats, const std::function<void(int)>& fn){
+    // Warm up caches, page in buffers and create any thread_local state
+    for (int i = 0; i < 3; i++){
+        fn(i);
+    }
+
+    std::vector<double> samples;
+    uint64_t total_iterations = 0;
+    for (int r = 0; r < repeats; r++){
+        uint64_t iterations = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed(0);
+        while (elapsed.count() < min_time_sec){
+            for (int i = 0; i < 4; i++){
+                fn(static_cast<int>(iterations++));
+            }
+            elapsed = std::chrono::steady_clock::now() - start;
+        }
+        samples.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / iterations);
+        total_iterations += iterations;
+    }
+    std::sort(samples.begin(), samples.end());
+    return {stage, resolution, width, height, total_iterations, samples[samples.size() / 2]};
+}
+
+static void print_result(const BenchResult& result, const size_t frame_bytes){
+    double pixels = static_cast<double>(result.width) * result.height;
+    std::cout << std::left << std::setw(20) << result.stage << std::setw(22) << result.resolution
+              << std::right << std::setw(5) << result.width << "x" << std::left << std::setw(6) << result.height
+              << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << result.ns_per_frame / 1e6 << " ms"
+              << std::setw(10) << result.ns_per_frame / pixels << " ns/px"
+              << std::setprecision(1) << std::setw(10) << frame_bytes / (result.ns_per_frame / 1e9) / 1e6 << " MB/s"
+              << "\n" << std::flush;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string csv_path;
+    std::string filter;
+    double min_time_sec = 0.2;
+    int repeats = 5;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--csv" && has_value){
+            csv_path = argv[++i];
+        } else if (arg == "--min-time" && has_value){
+            min_time_sec = std::atof(argv[++i]);
+        } else if (arg == "--repeats" && has_value){
+            repeats = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--filter" && has_value){
+            filter = argv[++i];
+        } else if (arg == "-h" || arg == "--help"){
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Unrecognized argument '" << arg << "'\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<std::pair<BenchResult, size_t>> results;
+    auto record = [&](const std::string& stage, const std::string& resolution, const int width, const int height,
+                      const size_t frame_bytes, const std::function<void(int)>& fn){
+        if (!filter.empty() && stage.find(filter) == std::string::npos){
+            return;
+        }
+        BenchResult result = run_stage(stage, resolution, width, height, min_time_sec, repeats, fn);
+        print_result(result, frame_bytes);
+        results.emplace_back(result, frame_bytes);
+    };
+
+    /***************************************
+     *                COLOR                *
+     ***************************************/
+
+    for (int res = K4A_COLOR_RESOLUTION_720P; res < COLOR_RESOLUTION_NAMES.size(); res++){
+        auto [width, height] = get_color_resolution_size(static_cast<k4a_color_resolution_t>(res));
+        const std::string resolution = COLOR_RESOLUTION_NAMES[res];
+        const size_t bgra_size = static_cast<size_t>(width) * height * 4;
+
+        std::vector<std::vector<uint8_t>> jpeg_frames;
+        std::vector<std::vector<uint8_t>> bgra_frames;
+        uint32_t noise_state = 0x2545F491u;
+        for (int f = 0; f < SYNTHETIC_PATTERN_FRAMES; f++){
+            jpeg_frames.push_back(render_color_pattern(K4A_IMAGE_FORMAT_COLOR_MJPG, width, height, f, noise_state));
+            bgra_frames.push_back(render_color_pattern(K4A_IMAGE_FORMAT_COLOR_BGRA32, width, height, f, noise_state));
+        }
+        std::vector<uint8_t> bgra_out(bgra_size);
+
+        record("mjpeg_decode", resolution, width, height, bgra_size, [&](int i){
+            const std::vector<uint8_t>& jpeg = jpeg_frames[i % SYNTHETIC_PATTERN_FRAMES];
+            decode_mjpeg_to_bgra(jpeg.data(), jpeg.size(), bgra_out.data(), width, height);
+            bench_sink = bench_sink + bgra_out[i % bgra_size];
+        });
+
+        // Scaled decode used when only the thumbnail is shown (same scale selection as process_capture)
+        int scale_denom = 1;
+        while (scale_denom < 8 && width / (scale_denom * 2) >= THUMBNAIL_WIDTH && height / (scale_denom * 2) >= THUMBNAIL_HEIGHT){
+            scale_denom *= 2;
+        }
+        const int scaled_width = (width + scale_denom - 1) / scale_denom;
+        const int scaled_height = (height + scale_denom - 1) / scale_denom;
+        record("mjpeg_decode_1/" + std::to_string(scale_denom), resolution, width, height, bgra_size, [&](int i){
+            const std::vector<uint8_t>& jpeg = jpeg_frames[i % SYNTHETIC_PATTERN_FRAMES];
+            decode_mjpeg_to_bgra(jpeg.data(), jpeg.size(), bgra_out.data(), scaled_width, scaled_height);
+            bench_sink = bench_sink + bgra_out[i % (static_cast<size_t>(scaled_width) * scaled_height * 4)];
+        });
+
+        record("bgra_copy", resolution, width, height, bgra_size, [&](int i){
+            memcpy(bgra_out.data(), bgra_frames[i % SYNTHETIC_PATTERN_FRAMES].data(), bgra_size);
+            bench_sink = bench_sink + bgra_out[i % bgra_size];
+        });
+
+        record("color_hflip", resolution, width, height, bgra_size, [&](int i){
+            hflip_bgra(bgra_out.data(), width, height);
+            bench_sink = bench_sink + bgra_out[i % bgra_size];
+        });
+
+        record("color_thumbnail", resolution, width, height, bgra_size, [&](int i){
+            std::shared_ptr<Image<uint8_t>> thumbnail = make_thumbnail(bgra_frames[i % SYNTHETIC_PATTERN_FRAMES].data(), width, height, 4);
+            bench_sink = bench_sink + thumbnail->get_buffer()[0];
+        });
+
+        // Optional encode of uncompressed color before recording, at the default quality
+        const std::array<std::pair<k4a_image_format_t, const char*>, 3> encode_formats {{
+            {K4A_IMAGE_FORMAT_COLOR_BGRA32, "bgra"}, {K4A_IMAGE_FORMAT_COLOR_NV12, "nv12"}, {K4A_IMAGE_FORMAT_COLOR_YUY2, "yuy2"}
+        }};
+        for (const auto& [format, name] : encode_formats){
+            const int stride = format == K4A_IMAGE_FORMAT_COLOR_BGRA32 ? width * 4 : (format == K4A_IMAGE_FORMAT_COLOR_YUY2 ? width * 2 : width);
+            std::vector<std::vector<uint8_t>> raw_frames;
+            for (int f = 0; f < SYNTHETIC_PATTERN_FRAMES; f++){
+                raw_frames.push_back(format == K4A_IMAGE_FORMAT_COLOR_BGRA32 ? bgra_frames[f] : render_color_pattern(format, width, height, f, noise_state));
+            }
+            record(std::string("jpeg_encode_") + name, resolution, width, height, bgra_size, [&, format = format, stride](int i){
+                const uint8_t* jpeg;
+                size_t jpeg_size;
+                if (encode_color_to_jpeg(format, raw_frames[i % SYNTHETIC_PATTERN_FRAMES].data(), width, height, stride, RecordingOptions().jpeg_quality, &jpeg, &jpeg_size)){
+                    bench_sink = bench_sink + jpeg[i % jpeg_size];
+                }
+            });
+        }
+    }
+
+    /***************************************
+     *              DEPTH / IR             *
+     ***************************************/
+
+    for (int mode = K4A_DEPTH_MODE_NFOV_2X2BINNED; mode < DEPTH_MODE_NAMES.size(); mode++){
+        auto [width, height] = get_depth_mode_size(static_cast<k4a_depth_mode_t>(mode));
+        const std::string resolution = DEPTH_MODE_NAMES[mode];
+        const size_t ir_size = static_cast<size_t>(width) * height * sizeof(uint16_t);
+        const double expected_pixel_range_max = mode == K4A_DEPTH_MODE_PASSIVE_IR ? 100.0 : 1000.0;
+
+        std::vector<std::vector<uint16_t>> depth_frames(SYNTHETIC_PATTERN_FRAMES);
+        std::vector<std::vector<uint16_t>> ir_frames(SYNTHETIC_PATTERN_FRAMES);
+        uint32_t noise_state = 0x2545F491u;
+        for (int f = 0; f < SYNTHETIC_PATTERN_FRAMES; f++){
+            render_depth_ir_pattern(width, height, f, noise_state, depth_frames[f], ir_frames[f]);
+        }
+        std::vector<uint8_t> ir_out(static_cast<size_t>(width) * height);
+
+        for (bool hflip : {false, true}){
+            record(hflip ? "ir_scale_hflip" : "ir_scale", resolution, width, height, ir_size, [&, hflip](int i){
+                scale_ir_to_u8(ir_frames[i % SYNTHETIC_PATTERN_FRAMES].data(), ir_out.data(), width, height, expected_pixel_range_max, hflip);
+                bench_sink = bench_sink + ir_out[i % ir_out.size()];
+            });
+        }
+
+        record("ir_thumbnail", resolution, width, height, ir_size, [&](int i){
+            std::shared_ptr<Image<uint8_t>> thumbnail = make_thumbnail(ir_out.data(), width, height, 1);
+            bench_sink = bench_sink + thumbnail->get_buffer()[0];
+        });
+
+        // Motion-triggered recording runs this on the capture loop for every capture
+        MotionDetector motion_detector;
+        record("motion_detect", resolution, width, height, ir_size, [&](int i){
+            std::vector<uint16_t>& frame = ir_frames[i % SYNTHETIC_PATTERN_FRAMES];
+            k4a::image img = k4a::image::create_from_buffer(K4A_IMAGE_FORMAT_IR16, width, height, width * sizeof(uint16_t),
+                reinterpret_cast<uint8_t*>(frame.data()), ir_size, nullptr, nullptr);
+            bench_sink = bench_sink + static_cast<uint8_t>(motion_detector.update(img) * 255);
+        });
+
+        // Lossless compression used for spool recordings (exact round trips are checked by the rvl_round_trip test)
+        const size_t num_pixels = static_cast<size_t>(width) * height;
+        std::vector<uint8_t> compressed(rvl_max_compressed_size(num_pixels));
+        std::vector<uint16_t> decompressed(num_pixels);
+        for (const auto& [name, frames] : {std::make_pair(std::string("depth"), &depth_frames), std::make_pair(std::string("ir"), &ir_frames)}){
+            if (frames->front().empty()){
+                continue;
+            }
+            size_t total_compressed = 0;
+            for (int f = 0; f < SYNTHETIC_PATTERN_FRAMES; f++){
+                total_compressed += rvl_compress((*frames)[f].data(), num_pixels, compressed.data());
+            }
+            std::cout << "rvl_" << name << " " << resolution << ": compression ratio " << std::setprecision(2)
+                      << static_cast<double>(ir_size) * SYNTHETIC_PATTERN_FRAMES / total_compressed << "\n";
+
+            size_t compressed_size = 0;
+            record("rvl_enc_" + name, resolution, width, height, ir_size, [&, frames](int i){
+                compressed_size = rvl_compress((*frames)[i % SYNTHETIC_PATTERN_FRAMES].data(), num_pixels, compressed.data());
+                bench_sink = bench_sink + compressed[i % compressed_size];
+            });
+            compressed_size = rvl_compress(frames->front().data(), num_pixels, compressed.data());
+            record("rvl_dec_" + name, resolution, width, height, ir_size, [&](int i){
+                rvl_decompress(compressed.data(), compressed_size, decompressed.data(), num_pixels);
+                bench_sink = bench_sink + static_cast<uint8_t>(decompressed[i % num_pixels]);
+            });
+        }
+    }
+
+    if (!csv_path.empty()){
+        std::ofstream csv(csv_path);
+        if (!csv){
+            std::cerr << "[ERROR] Could not open '" << csv_path << "' for writing\n";
+            return 1;
+        }
+        csv << "stage,resolution,width,height,iterations,ns_per_frame,ns_per_pixel,mb_per_s\n";
+        for (const auto& [result, frame_bytes] : results){
+            csv << result.stage << ",\"" << result.resolution << "\"," << result.width << "," << result.height << ","
+                << result.iterations << "," << result.ns_per_frame << "," << result.ns_per_frame / (static_cast<double>(result.width) * result.height) << ","
+                << frame_bytes / (result.ns_per_frame / 1e9) / 1e6 << "\n";
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <numeric>
+
+#include "burst.hpp"
+#include "spool.hpp"
+#include "capture.hpp"
+#include "trace.hpp"
+
+BurstSink::BurstSink(std::unique_ptr<RecordingSink> sink, const uint32_t num_captures, const size_t capture_bytes)
+    : m_sink(std::move(sink)), m_slots(num_captures), m_num_captures(num_captures), m_claimed(num_captures)
+{
+    // resize() zero-fills, which also commits the pages before the first burst
+    for (Slot& slot : m_slots){
+        slot.data.resize(capture_bytes);
+    }
+    m_flush_thread = std::thread([this]{
+        trace_set_thread_name("Burst Flush");
+        flush_loop();
+    });
+}
+
+BurstSink::~BurstSink(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_flush_thread.join();
+}
+
+void BurstSink::trigger(){
+    bool expected = false;
+    if (!m_busy.compare_exchange_strong(expected, true)){
+        return;
+    }
+    m_filled = 0;
+    m_claimed = 0;
+}
+
+void BurstSink::write_capture(const k4a::capture& capture){
+    uint32_t idx = m_claimed.load();
+    do {
+        if (idx >= m_num_captures){
+            return;
+        }
+    } while (!m_claimed.compare_exchange_weak(idx, idx + 1));
+
+    {
+        TraceSpan copy_span("burst_copy");
+        Slot& slot = m_slots[idx];
+        SpoolCaptureEncoder encoder(capture, false);
+        if (encoder.get_size() > slot.data.size()){
+            slot.data.resize(encoder.get_size());
+        }
+        encoder.write(slot.data.data());
+        slot.size = encoder.get_size();
+        slot.device_timestamp_usec = encoder.get_device_timestamp_usec();
+    }
+    if (m_filled.fetch_add(1) + 1 == m_num_captures){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_flush_requested = true;
+        m_cv.notify_all();
+    }
+}
+
+void BurstSink::flush_loop(){
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true){
+        m_cv.wait(lock, [this]{ return m_stop || m_flush_requested; });
+        if (m_flush_requested){
+            m_flush_requested = false;
+            lock.unlock();
+            flush(m_num_captures);
+            lock.lock();
+        } else {
+            // Stopped mid-burst: no more captures will arrive, so write the ones that did
+            if (m_busy){
+                m_claimed = m_num_captures;
+                flush(m_filled);
+            }
+            break;
+        }
+    }
+}
+
+void BurstSink::flush(const uint32_t num_slots){
+    TraceSpan flush_span("burst_flush");
+    // Pool threads can finish out of order
+    std::vector<uint32_t> order(num_slots);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](const uint32_t a, const uint32_t b){
+        return m_slots[a].device_timestamp_usec < m_slots[b].device_timestamp_usec;
+    });
+    for (uint32_t idx : order){
+        try {
+            m_sink->write_capture(decode_spool_capture(m_slots[idx].data.data(), m_slots[idx].size));
+            m_num_written.fetch_add(1, std::memory_order_relaxed);
+        } catch (const std::exception& e){
+            print_error_info(e, "Failed to write burst capture to '" + m_sink->get_path() + "'");
+        }
+    }
+    m_busy = false;
+}
+
+size_t estimate_burst_capture_bytes(const k4a_device_configuration_t& config){
+    size_t bytes = BURST_CAPTURE_MARGIN_BYTES;
+    if (config.color_resolution != K4A_COLOR_RESOLUTION_OFF){
+        auto [width, height] = get_color_resolution_size(config.color_resolution);
+        size_t pixels = static_cast<size_t>(width) * height;
+        switch (config.color_format){
+            case K4A_IMAGE_FORMAT_COLOR_MJPG:   bytes += pixels; break;
+            case K4A_IMAGE_FORMAT_COLOR_NV12:   bytes += pixels * 3 / 2; break;
+            case K4A_IMAGE_FORMAT_COLOR_YUY2:   bytes += pixels * 2; break;
+            default:                            bytes += pixels * 4; break;
+        }
+    }
+    if (config.depth_mode != K4A_DEPTH_MODE_OFF){
+        auto [width, height] = get_depth_mode_size(config.depth_mode);
+        int num_images = config.depth_mode == K4A_DEPTH_MODE_PASSIVE_IR ? 1 : 2;
+        bytes += static_cast<size_t>(width) * height * sizeof(uint16_t) * num_images;
+    }
+    return bytes;
+}
+
+uint32_t get_burst_num_captures(const RecordingOptions& recording_options, const size_t capture_bytes){
+    const size_t budget_bytes = static_cast<size_t>(std::max(recording_options.burst_budget_mb, 0)) << 20;
+    const size_t fitting = capture_bytes > 0 ? budget_bytes / capture_bytes : 0;
+    return static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(std::max(recording_options.burst_captures, 1), fitting)));
+}
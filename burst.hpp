@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+
+#include <k4a/k4a.hpp>
+
+#include "recording_sink.hpp"
+
+// Room left per preallocated capture for MJPEG frames larger than expected, and for the spool layout's headers
+#define BURST_CAPTURE_MARGIN_BYTES (1 << 16)
+
+/***********************************************************
+ *                     BURST CAPTURE                       *
+ ***********************************************************/
+
+// Records a burst of the next N captures of one device per trigger(). Captures are copied as-is (spool capture layout,
+// no compression) into buffers allocated and touched up front, so a burst at full frame rate costs the pool threads one
+// memcpy per capture and never allocates. Once the burst is complete, a flush thread writes it to the wrapped sink in
+// timestamp order. Captures outside a burst are discarded, and triggers are ignored until the last burst is written.
+class BurstSink : public RecordingSink {
+    private:
+        struct Slot {
+            std::vector<uint8_t> data;          // kept at full size; only the first `size` bytes are used
+            size_t size = 0;
+            int64_t device_timestamp_usec = 0;
+        };
+
+        std::unique_ptr<RecordingSink> m_sink;
+        std::vector<Slot> m_slots;
+        const uint32_t m_num_captures;
+        std::atomic<uint32_t> m_claimed;        // slots handed out in the current burst; m_num_captures when idle
+        std::atomic<uint32_t> m_filled = 0;
+        std::atomic<bool> m_busy = false;       // from trigger() until the burst is written
+        std::atomic<uint64_t> m_num_written = 0;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_flush_requested = false;
+        bool m_stop = false;
+        std::thread m_flush_thread;
+
+        void flush_loop();
+        void flush(const uint32_t num_slots);
+    public:
+        // capture_bytes: expected size of one capture (see estimate_burst_capture_bytes)
+        BurstSink(std::unique_ptr<RecordingSink> sink, const uint32_t num_captures, const size_t capture_bytes);
+        // Writes whatever an unfinished burst has captured
+        ~BurstSink();
+        BurstSink(const BurstSink&) = delete;
+        BurstSink& operator=(const BurstSink&) = delete;
+
+        void write_capture(const k4a::capture& capture) override;
+        std::string get_path() override { return m_sink->get_path(); }
+        // Starts a burst, unless the previous one is still being captured or written
+        void trigger() override;
+        RecordingSink* get_wrapped_sink() override { return m_sink.get(); }
+
+        // Whether the current burst still wants captures, so the capture loop knows to send them
+        bool is_capturing() const { return m_claimed.load(std::memory_order_relaxed) < m_num_captures; }
+        bool is_busy() const { return m_busy.load(std::memory_order_relaxed); }
+        uint32_t get_num_filled() const { return m_filled.load(std::memory_order_relaxed); }
+        uint32_t get_num_captures() const { return m_num_captures; }
+        uint64_t get_num_written() const { return m_num_written.load(std::memory_order_relaxed); }
+};
+
+// Uncompressed size of one capture, with MJPEG color assumed at a byte per pixel (plus BURST_CAPTURE_MARGIN_BYTES)
+size_t estimate_burst_capture_bytes(const k4a_device_configuration_t& config);
+// Captures per burst: burst_captures, reduced to what fits in burst_budget_mb (at least one)
+uint32_t get_burst_num_captures(const RecordingOptions& recording_options, const size_t capture_bytes);
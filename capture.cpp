@@ -0,0 +1,821 @@
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <typeinfo>
+#include <future>
+
+#include <turbojpeg.h>
+
+#include "json.hpp"
+
+#include "capture.hpp"
+#include "trace.hpp"
+#include "spool.hpp"
+#include "pretrigger.hpp"
+#include "burst.hpp"
+#include "segment.hpp"
+#include "save_paths.hpp"
+#include "jpeg_encode.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+void print_error_info(const std::exception& e, const std::string info_msg){
+    std::cerr << "[ERROR]:" << (info_msg.empty() ? "" : " " + info_msg) << std::endl;
+    std::cerr << "  Type: " << typeid(e).name() << std::endl;
+    std::cerr << "  Info: " << e.what() << std::endl;
+}
+
+int get_fps_value(const k4a_fps_t fps){
+    return std::atoi(FPS_MODE_NAMES[fps]);
+}
+
+unsigned int get_preview_decimation(const k4a_fps_t camera_fps, const int preview_fps_limit){
+    if (preview_fps_limit <= 0){
+        return 1;
+    }
+    return std::max(1, (get_fps_value(camera_fps) + preview_fps_limit - 1) / preview_fps_limit);
+}
+
+void remove_trailing_nulls(std::string& s){
+    s.erase(std::find(s.begin(), s.end(), '\0'), s.end());
+}
+
+// Runs fn(i) for each listed device on its own thread, recording how long each call took; once every call has
+// returned, the first exception (if any) is rethrown
+template <typename F>
+static void run_on_devices(const std::vector<int>& device_list, std::vector<std::chrono::microseconds>& durations, F fn){
+    std::vector<std::future<void>> futures;
+    for (const int i : device_list){
+        futures.push_back(std::async(std::launch::async, [&, i](){
+            auto call_start = std::chrono::steady_clock::now();
+            fn(i);
+            durations[i] = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - call_start);
+        }));
+    }
+    std::exception_ptr first_error;
+    for (std::future<void>& future : futures){
+        try {
+            future.get();
+        } catch (...){
+            if (!first_error){
+                first_error = std::current_exception();
+            }
+        }
+    }
+    if (first_error){
+        std::rethrow_exception(first_error);
+    }
+}
+
+void start_streaming(std::vector<std::unique_ptr<CaptureSource>>& devices, const std::vector<k4a_device_configuration_t>& configs, std::vector<DeviceStartupTiming>* timings, const bool imu){
+    // Only the order between tiers matters (subordinates must be waiting before the master starts), so each tier starts concurrently
+    std::vector<std::chrono::microseconds> durations(devices.size());
+    auto tiers_start = std::chrono::steady_clock::now();
+    for (auto wired_sync_mode : DEVICE_STREAMING_START_ORDER){
+        std::vector<int> tier;
+        for (int i = 0; i < devices.size(); i++){
+            if (configs[i].wired_sync_mode == wired_sync_mode){
+                tier.push_back(i);
+            }
+        }
+        run_on_devices(tier, durations, [&](const int i){ devices[i]->start_cameras(&configs[i]); });
+    }
+    // The IMU can only start once the device's cameras are running
+    if (imu){
+        for (auto& device : devices){
+            if (device->has_imu()){
+                device->start_imu();
+            }
+        }
+    }
+    auto tiers_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tiers_start);
+
+    std::cout << "\nDevice\t\tStart (ms)\n" << std::string(32, '-') << "\n";
+    for (int i = 0; i < devices.size(); i++){
+        std::cout << i << "\t\t" << durations[i].count() / 1000.0 << "\n";
+    }
+    std::cout << "Started " << devices.size() << " device(s) in " << tiers_elapsed.count() << " ms" << std::endl;
+    if (timings != nullptr){
+        timings->resize(devices.size());
+        for (int i = 0; i < devices.size(); i++){
+            (*timings)[i].start = durations[i];
+        }
+    }
+}
+
+void stop_streaming(
+    std::vector<std::unique_ptr<CaptureSource>>& devices,
+    const std::vector<k4a_device_configuration_t>& configs,
+    std::vector<std::unique_ptr<RecordingSink>>& recordings,
+    const bool close_devices
+    ){
+    // Stopping an IMU that was never started is a no-op
+    for (auto& device : devices){
+        device->stop_imu();
+    }
+    for (auto wired_sync_mode : DEVICE_STREAMING_STOP_ORDER){
+        for (int i = 0; i < devices.size(); i++){
+            if (configs[i].wired_sync_mode == wired_sync_mode){
+                devices[i]->stop_cameras();
+            }
+        }
+    }
+    // k4a::recording destructor will call flush & close automatically
+    recordings.clear();
+
+    // DeviceSource destructor closes the k4a::device
+    if (close_devices){
+        devices.clear();
+    }
+}
+
+// Open each installed device just long enough to read its serial number
+std::vector<std::string> get_available_device_serials(const int num_available_devices){
+    std::vector<std::string> serials;
+    for (int i = 0; i < num_available_devices; i++){
+        k4a::device device = k4a::device::open(i);
+        serials.emplace_back(device.get_serialnum());
+        device.close();
+    }
+    return serials;
+}
+
+void open_devices(std::vector<int>& device_idxs, std::vector<std::unique_ptr<CaptureSource>>& devices, std::vector<DeviceStartupTiming>* timings){
+    // Create device handles concurrently; if any fails, the ones already opened are closed again
+    std::vector<std::unique_ptr<CaptureSource>> opened(device_idxs.size());
+    std::vector<std::chrono::microseconds> durations(device_idxs.size());
+    std::vector<int> slots;
+    for (int i = 0; i < device_idxs.size(); i++){
+        slots.push_back(i);
+    }
+    auto open_start = std::chrono::steady_clock::now();
+    run_on_devices(slots, durations, [&](const int i){ opened[i] = std::make_unique<DeviceSource>(device_idxs[i]); });
+    auto open_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - open_start);
+    for (std::unique_ptr<CaptureSource>& device : opened){
+        devices.push_back(std::move(device));
+    }
+
+    // Print device info
+    std::cout << "\nDevice No.\tSerial No.\tOpen (ms)\n" << std::string(40, '-') << "\n";
+    for (int i = 0; i < devices.size(); i++){
+        std::cout << device_idxs[i] << "\t\t" << devices[i]->get_serialnum() << "\t" << durations[i].count() / 1000.0 << "\n";
+    }
+    std::cout << "Opened " << devices.size() << " device(s) in " << open_elapsed.count() << " ms" << std::endl;
+    if (timings != nullptr){
+        timings->assign(devices.size(), DeviceStartupTiming());
+        for (int i = 0; i < devices.size(); i++){
+            (*timings)[i].open = durations[i];
+        }
+    }
+    return;
+}
+
+std::mutex k4a_log_mutex;
+
+void k4a_log_callback(void* context, k4a_log_level_t level, const char* file, int line, const char* msg){
+    auto k4a_log_msgs = reinterpret_cast<std::vector<std::string>*>(context);
+    std::lock_guard<std::mutex> lock(k4a_log_mutex);
+    k4a_log_msgs->push_back(msg);
+}
+
+void load_config_json(
+    const std::string& input_file_path,
+    std::vector<std::string>& available_device_serials,
+    std::vector<std::string>& available_device_nicknames,
+    const std::shared_ptr<bool[]> available_device_checkboxes,
+    bool* identical_configs,
+    std::vector<k4a_device_configuration_t>& configs,
+    bool* recording_enabled,
+    bool* continuous_recording,
+    std::string& recording_save_path,
+    RecordingOptions* recording_options
+){
+    std::ifstream ifs(input_file_path);
+    std::string json_str((std::istreambuf_iterator<char>(ifs)), (std::istreambuf_iterator<char>()));
+    json::JSON config_json = json::JSON::Load(json_str);
+    if (config_json.IsNull()){
+        throw std::runtime_error("Input file '" + input_file_path + "' is not a valid JSON.");
+    }
+
+    *identical_configs = config_json["identical_configs"].ToBool();
+    if (config_json.hasKey("save_path")){
+        std::string save_path = config_json["save_path"].ToStringNoEscape();
+        recording_save_path = save_path;
+        *recording_enabled = !recording_save_path.empty();
+    }
+    if (config_json.hasKey("continuous_recording")){
+        *continuous_recording = config_json["continuous_recording"].ToBool();
+    }
+    if (config_json.hasKey("recording_format")){
+        recording_options->format = static_cast<RecordingFormat>(parse_name(RECORDING_FORMAT_NAMES, config_json["recording_format"].ToString()));
+    }
+    if (config_json.hasKey("compress_depth_ir")){
+        recording_options->compress_depth_ir = config_json["compress_depth_ir"].ToBool();
+    }
+    if (config_json.hasKey("jpeg_encode_color")){
+        recording_options->jpeg_encode_color = config_json["jpeg_encode_color"].ToBool();
+    }
+    if (config_json.hasKey("jpeg_quality")){
+        recording_options->jpeg_quality = config_json["jpeg_quality"].ToInt();
+    }
+    if (config_json.hasKey("pretrigger")){
+        recording_options->pretrigger = config_json["pretrigger"].ToBool();
+    }
+    if (config_json.hasKey("pretrigger_sec")){
+        recording_options->pretrigger_sec = static_cast<float>(config_json["pretrigger_sec"].ToFloat());
+    }
+    if (config_json.hasKey("pretrigger_budget_mb")){
+        recording_options->pretrigger_budget_mb = config_json["pretrigger_budget_mb"].ToInt();
+    }
+    if (config_json.hasKey("burst")){
+        recording_options->burst = config_json["burst"].ToBool();
+    }
+    if (config_json.hasKey("burst_captures")){
+        recording_options->burst_captures = config_json["burst_captures"].ToInt();
+    }
+    if (config_json.hasKey("burst_budget_mb")){
+        recording_options->burst_budget_mb = config_json["burst_budget_mb"].ToInt();
+    }
+    if (config_json.hasKey("segment_minutes")){
+        recording_options->segment_minutes = static_cast<float>(config_json["segment_minutes"].ToFloat());
+    }
+    if (config_json.hasKey("segment_size_mb")){
+        recording_options->segment_size_mb = config_json["segment_size_mb"].ToInt();
+    }
+    if (config_json.hasKey("extra_save_paths")){
+        recording_options->extra_save_paths.clear();
+        for (const json::JSON& path : config_json["extra_save_paths"].ArrayRange()){
+            recording_options->extra_save_paths.push_back(path.ToStringNoEscape());
+        }
+    }
+    if (config_json.hasKey("save_path_placement")){
+        recording_options->placement = static_cast<SavePathPlacement>(parse_name(SAVE_PATH_PLACEMENT_NAMES, config_json["save_path_placement"].ToString()));
+    }
+    if (config_json.hasKey("timelapse_mode")){
+        recording_options->timelapse_mode = static_cast<TimelapseMode>(parse_name(TIMELAPSE_MODE_NAMES, config_json["timelapse_mode"].ToString()));
+    }
+    if (config_json.hasKey("timelapse_frames")){
+        recording_options->timelapse_frames = config_json["timelapse_frames"].ToInt();
+    }
+    if (config_json.hasKey("timelapse_sec")){
+        recording_options->timelapse_sec = static_cast<float>(config_json["timelapse_sec"].ToFloat());
+    }
+    if (config_json.hasKey("frame_metadata")){
+        recording_options->frame_metadata = config_json["frame_metadata"].ToBool();
+    }
+    if (config_json.hasKey("imu")){
+        recording_options->imu = config_json["imu"].ToBool();
+    }
+    if (config_json.hasKey("motion_trigger")){
+        recording_options->motion_trigger = config_json["motion_trigger"].ToBool();
+    }
+    if (config_json.hasKey("motion_source")){
+        recording_options->motion_source = static_cast<MotionSource>(parse_name(MOTION_SOURCE_NAMES, config_json["motion_source"].ToString()));
+    }
+    if (config_json.hasKey("motion_threshold_pct")){
+        recording_options->motion_threshold_pct = static_cast<float>(config_json["motion_threshold_pct"].ToFloat());
+    }
+    if (config_json.hasKey("motion_hold_sec")){
+        recording_options->motion_hold_sec = static_cast<float>(config_json["motion_hold_sec"].ToFloat());
+    }
+    if (config_json.hasKey("motion_propagate")){
+        recording_options->motion_propagate = config_json["motion_propagate"].ToBool();
+    }
+
+    configs.clear();
+    int num_available_devices = available_device_serials.size();
+    for (int i = 0; i < num_available_devices; i++){
+        std::string serial = available_device_serials[i];
+        if (config_json.hasKey(serial)){
+            available_device_nicknames[i] = config_json[serial]["nickname"].ToString();
+            available_device_checkboxes[i] = true;
+            std::string key = *identical_configs ? "*" : serial;
+
+            k4a_device_configuration_t config = DEFAULT_CONFIG;
+            config.color_format = static_cast<k4a_image_format_t>(index_of(COLOR_FORMAT_NAMES, config_json[key]["color_format"].ToString().c_str()));
+            config.color_resolution = static_cast<k4a_color_resolution_t>(index_of(COLOR_RESOLUTION_NAMES, config_json[key]["color_resolution"].ToString().c_str()));
+            config.depth_mode = static_cast<k4a_depth_mode_t>(index_of(DEPTH_MODE_NAMES, config_json[key]["depth_mode"].ToString().c_str()));
+            config.camera_fps = static_cast<k4a_fps_t>(config_json[key]["fps"].ToInt());
+            config.wired_sync_mode = static_cast<k4a_wired_sync_mode_t>(index_of(SYNC_MODE_NAMES, config_json[key]["sync_mode"].ToString().c_str()));
+            configs.push_back(config);
+        } else {
+            available_device_checkboxes[i] = false;
+        }
+    }
+}
+
+void save_config_json(
+    const std::string& output_file_path,
+    const bool identical_configs,
+    const std::vector<std::string>& available_device_serials,
+    const std::vector<std::string>& available_device_nicknames,
+    const std::shared_ptr<bool[]> available_device_checkboxes,
+    const std::vector<k4a_device_configuration_t>& configs,
+    const std::string& recording_save_path,
+    const bool continuous_recording,
+    const RecordingOptions& recording_options
+){
+    json::JSON j;
+    j["identical_configs"] = identical_configs;
+    j["imu"] = recording_options.imu;
+    if (!recording_save_path.empty()){
+        j["save_path"] = recording_save_path;
+        j["continuous_recording"] = continuous_recording;
+        j["recording_format"] = RECORDING_FORMAT_NAMES[recording_options.format];
+        j["compress_depth_ir"] = recording_options.compress_depth_ir;
+        j["jpeg_encode_color"] = recording_options.jpeg_encode_color;
+        j["jpeg_quality"] = recording_options.jpeg_quality;
+        j["pretrigger"] = recording_options.pretrigger;
+        j["pretrigger_sec"] = recording_options.pretrigger_sec;
+        j["pretrigger_budget_mb"] = recording_options.pretrigger_budget_mb;
+        j["burst"] = recording_options.burst;
+        j["burst_captures"] = recording_options.burst_captures;
+        j["burst_budget_mb"] = recording_options.burst_budget_mb;
+        j["segment_minutes"] = recording_options.segment_minutes;
+        j["segment_size_mb"] = recording_options.segment_size_mb;
+        j["extra_save_paths"] = json::Array();
+        for (const std::string& path : recording_options.extra_save_paths){
+            j["extra_save_paths"].append(path);
+        }
+        j["save_path_placement"] = SAVE_PATH_PLACEMENT_NAMES[recording_options.placement];
+        j["timelapse_mode"] = TIMELAPSE_MODE_NAMES[recording_options.timelapse_mode];
+        j["timelapse_frames"] = recording_options.timelapse_frames;
+        j["timelapse_sec"] = recording_options.timelapse_sec;
+        j["motion_trigger"] = recording_options.motion_trigger;
+        j["motion_source"] = MOTION_SOURCE_NAMES[recording_options.motion_source];
+        j["motion_threshold_pct"] = recording_options.motion_threshold_pct;
+        j["motion_hold_sec"] = recording_options.motion_hold_sec;
+        j["motion_propagate"] = recording_options.motion_propagate;
+        j["frame_metadata"] = recording_options.frame_metadata;
+    }
+    if (identical_configs){
+        j["*"]["color_format"] = COLOR_FORMAT_NAMES[configs[0].color_format];
+        j["*"]["color_resolution"] = COLOR_RESOLUTION_NAMES[configs[0].color_resolution];
+        j["*"]["depth_mode"] = DEPTH_MODE_NAMES[configs[0].depth_mode];
+        j["*"]["fps"] = static_cast<int>(configs[0].camera_fps); // stored in JSON as an integer, not string
+        j["*"]["sync_mode"] = SYNC_MODE_NAMES[configs[0].wired_sync_mode];
+    }
+    int opened_device_idx = 0;
+    for (int i = 0; i < available_device_serials.size(); i++){
+        // Only save opened devices
+        if (!available_device_checkboxes[i]){
+            continue;
+        }
+        auto serial = available_device_serials[i];
+        j[serial]["nickname"] = available_device_nicknames[i];
+        if (!identical_configs){
+            if (!j.hasKey(serial)) j[serial] = json::Object();
+            j[serial]["color_format"] = COLOR_FORMAT_NAMES[configs[opened_device_idx].color_format];
+            j[serial]["color_resolution"] = COLOR_RESOLUTION_NAMES[configs[opened_device_idx].color_resolution];
+            j[serial]["depth_mode"] = DEPTH_MODE_NAMES[configs[opened_device_idx].depth_mode];
+            j[serial]["fps"] = static_cast<int>(configs[opened_device_idx].camera_fps);  // stored in JSON as an integer, not string
+            j[serial]["sync_mode"] = SYNC_MODE_NAMES[configs[opened_device_idx].wired_sync_mode];
+        }
+        opened_device_idx++;
+    }
+    std::ofstream(output_file_path) << j.dump() << std::endl;
+}
+
+void initialize_recordings(
+    const bool recording_enabled,
+    const bool continuous_recording,
+    std::vector<bool>& recording_write_enables,
+    std::vector<std::unique_ptr<RecordingSink>>& recordings,
+    const std::vector<std::unique_ptr<CaptureSource>>& devices,
+    const std::vector<k4a_device_configuration_t>& configs,
+    const std::vector<int>& device_idxs,
+    const std::vector<std::string>& available_device_serials,
+    const std::vector<std::string>& available_device_nicknames,
+    const std::string& recording_save_path,
+    const RecordingOptions& recording_options,
+    std::vector<int>* save_path_idxs,
+    std::vector<std::unique_ptr<FrameMetadataWriter>>* frame_metadata
+){
+    recording_write_enables.clear();
+    recordings.clear();
+    if (save_path_idxs != nullptr){
+        save_path_idxs->clear();
+    }
+    if (frame_metadata != nullptr){
+        frame_metadata->clear();
+    }
+    if (!recording_enabled){
+        for (int i = 0; i < devices.size(); i++){
+            recording_write_enables.push_back(false);
+        }
+        return;
+    }
+
+    std::chrono::seconds rec_start_time = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch());
+    const bool segmented = recording_options.segment_minutes > 0 || recording_options.segment_size_mb > 0;
+    // Wired-sync devices share one schedule so their segments split on the same frame; standalone clocks are unrelated
+    std::shared_ptr<SegmentSchedule> sync_schedule;
+    // Encoded devices are recorded (and placed by bandwidth) as MJPEG
+    std::vector<k4a_device_configuration_t> recording_configs = configs;
+    std::vector<bool> jpeg_encodes(devices.size(), false);
+    for (int i = 0; i < devices.size(); i++){
+        if (recording_options.jpeg_encode_color && configs[i].color_resolution != K4A_COLOR_RESOLUTION_OFF &&
+            is_uncompressed_color_format(configs[i].color_format)){
+            jpeg_encodes[i] = true;
+            recording_configs[i].color_format = K4A_IMAGE_FORMAT_COLOR_MJPG;
+        }
+    }
+    const std::vector<std::string> save_paths = get_save_paths(recording_save_path, recording_options);
+    const std::vector<int> path_idxs = place_recordings(save_paths, recording_configs, recording_options.placement);
+    if (save_path_idxs != nullptr){
+        *save_path_idxs = path_idxs;
+    }
+    for (int i = 0; i < devices.size(); i++){
+        recording_write_enables.push_back(false);
+
+        std::string nickname = available_device_nicknames[device_idxs[i]];
+        if (nickname.empty()){
+            nickname = available_device_serials[device_idxs[i]];
+        }
+        const std::string base_name = std::to_string(rec_start_time.count()) + "_" + nickname;
+        const std::string serial = available_device_serials[device_idxs[i]];
+        const k4a::device& device = devices[i]->get_device();
+        const k4a_device_configuration_t config = recording_configs[i];
+        const std::string save_path = save_paths[path_idxs[i]];
+        // Only continuous recordings are fed IMU samples; a track in triggered/snapshot files would stay empty
+        const bool imu = recording_options.imu && continuous_recording && devices[i]->has_imu();
+        if (save_paths.size() > 1){
+            std::cout << "Recording " << nickname << " to '" << save_path << "'" << std::endl;
+        }
+        auto create_sink = [=, &device](const std::string& name) -> std::unique_ptr<RecordingSink> {
+            std::filesystem::path full_path = std::filesystem::path(save_path) / (name + RECORDING_FORMAT_EXTENSIONS[recording_options.format]);
+            if (recording_options.format == RECORDING_FORMAT_SPOOL){
+                return std::make_unique<SpoolSink>(full_path.string(), device, serial, config, recording_options.compress_depth_ir);
+            }
+            return std::make_unique<MkvSink>(full_path.string(), device, config, imu);
+        };
+        if (!segmented){
+            recordings.push_back(create_sink(base_name));
+        } else {
+            const int64_t frame_period_usec = 1000000 / get_fps_value(config.camera_fps);
+            std::shared_ptr<SegmentSchedule> schedule;
+            int64_t timestamp_offset_usec = 0;
+            if (config.wired_sync_mode == K4A_WIRED_SYNC_MODE_STANDALONE){
+                schedule = std::make_shared<SegmentSchedule>(recording_options.segment_minutes * 60, frame_period_usec);
+            } else {
+                if (sync_schedule == nullptr){
+                    sync_schedule = std::make_shared<SegmentSchedule>(recording_options.segment_minutes * 60, frame_period_usec);
+                }
+                schedule = sync_schedule;
+                timestamp_offset_usec = get_sync_timestamp_offset_usec(config);
+            }
+            // Zero-padded segment numbers keep the files in order when sorted by name
+            recordings.push_back(std::make_unique<SegmentedSink>([=](const uint32_t segment){
+                char suffix[16];
+                snprintf(suffix, sizeof(suffix), "_%03u", segment);
+                return create_sink(base_name + suffix);
+            }, schedule, timestamp_offset_usec, static_cast<uint64_t>(recording_options.segment_size_mb) << 20));
+        }
+        if (!continuous_recording && recording_options.pretrigger){
+            recordings.back() = std::make_unique<PretriggerSink>(std::move(recordings.back()), recording_options.pretrigger_sec,
+                                                                 static_cast<size_t>(recording_options.pretrigger_budget_mb) << 20);
+        } else if (!continuous_recording && recording_options.burst){
+            const size_t capture_bytes = estimate_burst_capture_bytes(config);
+            const uint32_t num_captures = get_burst_num_captures(recording_options, capture_bytes);
+            if (num_captures < static_cast<uint32_t>(recording_options.burst_captures)){
+                std::cout << "Bursts of " << nickname << " limited to " << num_captures << " captures by the " << recording_options.burst_budget_mb << " MB budget" << std::endl;
+            }
+            recordings.back() = std::make_unique<BurstSink>(std::move(recordings.back()), num_captures, capture_bytes);
+        }
+        // Outermost, so a pre-trigger window holds the (much smaller) encoded frames
+        if (jpeg_encodes[i]){
+            recordings.back() = std::make_unique<JpegEncodeSink>(std::move(recordings.back()), recording_options.jpeg_quality);
+        }
+        // One sidecar per device for the whole recording, segmented or not
+        if (frame_metadata != nullptr){
+            std::filesystem::path metadata_path = std::filesystem::path(save_path) / (base_name + FRAME_METADATA_EXTENSION);
+            frame_metadata->push_back(recording_options.frame_metadata ? std::make_unique<FrameMetadataWriter>(metadata_path.string(), serial, config.camera_fps, rec_start_time) : nullptr);
+        }
+    }
+}
+
+int64_t get_sync_timestamp_offset_usec(const k4a_device_configuration_t& config){
+    return config.wired_sync_mode == K4A_WIRED_SYNC_MODE_SUBORDINATE ? config.subordinate_delay_off_master_usec : 0;
+}
+
+std::vector<std::string> get_save_paths(const std::string& recording_save_path, const RecordingOptions& recording_options){
+    std::vector<std::string> save_paths {recording_save_path};
+    for (const std::string& path : recording_options.extra_save_paths){
+        if (!path.empty()){
+            save_paths.push_back(path);
+        }
+    }
+    return save_paths;
+}
+
+bool decode_mjpeg_to_bgra(const uint8_t* jpeg_buffer, const size_t jpeg_size, uint8_t* bgra_buffer, const unsigned int width, const unsigned int height){
+    // Creating a decompressor per frame is measurable at high frame rates, so each worker thread keeps one
+    thread_local std::unique_ptr<void, int(*)(tjhandle)> jpeg_decompressor(tjInitDecompress(), tjDestroy);
+    int result = tjDecompress2(jpeg_decompressor.get(), jpeg_buffer, jpeg_size, bgra_buffer, width, 0/*pitch*/, height, TJPF_BGRA, TJFLAG_FASTDCT | TJFLAG_FASTUPSAMPLE);
+    if (result != 0){
+        std::cerr << "[ERROR] Failed to properly decode image\n";
+        fprintf(stderr, "Error code:\t%d\n", result);
+        fprintf(stderr, "Error str:\t%s\n", tjGetErrorStr2(jpeg_decompressor.get()));
+        std::cerr << std::flush;
+    }
+    return result == 0;
+}
+
+void scale_ir_to_u8(const uint16_t* in_buffer, uint8_t* out_buffer, const unsigned int width, const unsigned int height, const double expected_pixel_range_max, const bool hflip){
+    double scale_factor = std::numeric_limits<uint8_t>::max() / expected_pixel_range_max;
+    for (unsigned int v = 0; v < height; v++){
+        for (unsigned int u = 0; u < width; u++){
+            unsigned int idx = v * width + u;
+            unsigned int flip_idx = v * width + ((width - 1) - u);
+            uint16_t scaled_value = in_buffer[idx] * scale_factor;
+            uint8_t out_value = scaled_value > std::numeric_limits<uint8_t>::max() ? std::numeric_limits<uint8_t>::max() : scaled_value;
+            out_buffer[hflip ? flip_idx : idx] = out_value;
+        }
+    }
+}
+
+void hflip_bgra(uint8_t* bgra_buffer, const unsigned int width, const unsigned int height){
+    uint32_t* buffer = reinterpret_cast<uint32_t*>(bgra_buffer);
+    for (unsigned int v = 0; v < height; v++){
+        for (unsigned int u = 0; u < width / 2; u++){
+            unsigned int idx = v * width + u;
+            unsigned int flip_idx = v * width + ((width - 1) - u);
+            uint32_t temp = buffer[idx];
+            buffer[idx] = buffer[flip_idx];
+            buffer[flip_idx] = temp;
+        }
+    }
+}
+
+// Rows are first summed vertically into per-column accumulators, then each output pixel sums `factor` columns
+void box_downscale_to_bgra(
+    const uint8_t* src,
+    const unsigned int width,
+    const unsigned int height,
+    const unsigned int channels,
+    const unsigned int factor,
+    uint8_t* dst,
+    const unsigned int dst_stride
+){
+    const unsigned int out_width = width / factor;
+    const unsigned int out_height = height / factor;
+    const unsigned int row_len = out_width * factor * channels;
+    const float inv_area = 1.0f / (factor * factor);
+
+    // Reused across calls on the same worker thread
+    thread_local std::vector<uint32_t> column_sums;
+    if (column_sums.size() < row_len){
+        column_sums.resize(row_len);
+    }
+    uint32_t* sums = column_sums.data();
+
+#ifdef USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 inv_area_ps = _mm_set1_ps(inv_area);
+#endif
+
+    for (unsigned int v = 0; v < out_height; v++){
+        std::fill(sums, sums + row_len, 0);
+
+        // Vertical pass
+        for (unsigned int r = 0; r < factor; r++){
+            const uint8_t* row = src + static_cast<size_t>(v * factor + r) * width * channels;
+            unsigned int i = 0;
+#ifdef USE_SSE2
+            for (; i + 16 <= row_len; i += 16){
+                __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+                __m128i lo = _mm_unpacklo_epi8(px, zero);
+                __m128i hi = _mm_unpackhi_epi8(px, zero);
+                __m128i* acc = reinterpret_cast<__m128i*>(sums + i);
+                _mm_storeu_si128(acc + 0, _mm_add_epi32(_mm_loadu_si128(acc + 0), _mm_unpacklo_epi16(lo, zero)));
+                _mm_storeu_si128(acc + 1, _mm_add_epi32(_mm_loadu_si128(acc + 1), _mm_unpackhi_epi16(lo, zero)));
+                _mm_storeu_si128(acc + 2, _mm_add_epi32(_mm_loadu_si128(acc + 2), _mm_unpacklo_epi16(hi, zero)));
+                _mm_storeu_si128(acc + 3, _mm_add_epi32(_mm_loadu_si128(acc + 3), _mm_unpackhi_epi16(hi, zero)));
+            }
+#endif
+            for (; i < row_len; i++){
+                sums[i] += row[i];
+            }
+        }
+
+        // Horizontal pass
+        uint8_t* out_row = dst + static_cast<size_t>(v) * dst_stride;
+        for (unsigned int u = 0; u < out_width; u++){
+            const uint32_t* block = sums + u * factor * channels;
+            uint8_t* out_px = out_row + 4 * u;
+            if (channels == 4){
+#ifdef USE_SSE2
+                __m128i sum = zero;
+                for (unsigned int k = 0; k < factor; k++){
+                    sum = _mm_add_epi32(sum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 4 * k)));
+                }
+                __m128i avg = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(sum), inv_area_ps));
+                avg = _mm_packs_epi32(avg, avg);
+                avg = _mm_packus_epi16(avg, avg);
+                uint32_t packed = static_cast<uint32_t>(_mm_cvtsi128_si32(avg));
+                memcpy(out_px, &packed, 4);
+#else
+                for (unsigned int c = 0; c < 4; c++){
+                    uint32_t sum = 0;
+                    for (unsigned int k = 0; k < factor; k++){
+                        sum += block[4 * k + c];
+                    }
+                    out_px[c] = static_cast<uint8_t>(sum * inv_area + 0.5f);
+                }
+#endif
+            } else {
+                uint32_t sum = 0;
+                for (unsigned int k = 0; k < factor; k++){
+                    sum += block[k];
+                }
+                uint8_t value = static_cast<uint8_t>(sum * inv_area + 0.5f);
+                out_px[0] = value;
+                out_px[1] = value;
+                out_px[2] = value;
+                out_px[3] = std::numeric_limits<uint8_t>::max();
+            }
+        }
+    }
+}
+
+std::shared_ptr<Image<uint8_t>> make_thumbnail(const uint8_t* src, const unsigned int width, const unsigned int height, const unsigned int channels){
+    std::shared_ptr<Image<uint8_t>> thumb = std::make_shared<Image<uint8_t>>(THUMBNAIL_HEIGHT, THUMBNAIL_WIDTH, 4);
+    memset(thumb->get_buffer(), 0, thumb->size());
+
+    unsigned int factor = std::max({1u, (width + THUMBNAIL_WIDTH - 1) / THUMBNAIL_WIDTH, (height + THUMBNAIL_HEIGHT - 1) / THUMBNAIL_HEIGHT});
+    unsigned int offset_x = (THUMBNAIL_WIDTH - width / factor) / 2;
+    unsigned int offset_y = (THUMBNAIL_HEIGHT - height / factor) / 2;
+    uint8_t* dst = thumb->get_buffer() + (offset_y * THUMBNAIL_WIDTH + offset_x) * 4;
+    box_downscale_to_bgra(src, width, height, channels, factor, dst, THUMBNAIL_WIDTH * 4);
+    return thumb;
+}
+
+void process_capture(
+    const std::shared_ptr<k4a::capture> capture,
+    const k4a_device_configuration_t& config,
+    rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>* color_queue,
+    rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>* ir_queue,
+    rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>* color_thumb_queue,
+    rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>* ir_thumb_queue,
+    const bool color_preview,
+    const bool ir_preview,
+    const bool thumbnail_preview,
+    const bool hflip_color,
+    const bool hflip_ir,
+    RecordingSink* recording,
+    const bool recording_write_enable,
+    FrameTiming timing,
+    DeviceMetrics* metrics,
+    FrameMetadataWriter* frame_metadata
+){
+    TraceSpan process_span("process_capture", timing.device_index);
+    timing.task_start = std::chrono::steady_clock::now();
+    if (metrics != nullptr){
+        metrics->latency.record(LATENCY_STAGE_POOL_WAIT, timing.arrival, timing.task_start);
+    }
+    // Stage durations for the sidecar record, filled in as the stages run
+    FrameMetadataRecord record = {};
+    auto elapsed_usec = [](const std::chrono::steady_clock::time_point from, const std::chrono::steady_clock::time_point to){
+        return static_cast<uint32_t>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(to - from).count()));
+    };
+
+    // Get image
+    k4a::image color_img = capture->get_color_image();
+    if (color_img.is_valid() && (color_preview || thumbnail_preview)){
+        bool success = false;
+        unsigned int width = color_img.get_width_pixels();
+        unsigned int height = color_img.get_height_pixels();
+
+        // When only a thumbnail is needed, let the JPEG decoder do most of the downscaling via DCT scaling
+        unsigned int scale_denom = 1;
+        if (!color_preview && color_img.get_format() == K4A_IMAGE_FORMAT_COLOR_MJPG){
+            while (scale_denom < 8 && width / (2 * scale_denom) >= THUMBNAIL_WIDTH && height / (2 * scale_denom) >= THUMBNAIL_HEIGHT){
+                scale_denom *= 2;
+            }
+            width = (width + scale_denom - 1) / scale_denom;
+            height = (height + scale_denom - 1) / scale_denom;
+        }
+        std::shared_ptr<Image<uint8_t>> color_disp = std::make_shared<Image<uint8_t>>(height, width, 4);
+
+        // MJPG
+        if (color_img.get_format() == K4A_IMAGE_FORMAT_COLOR_MJPG){
+            success = decode_mjpeg_to_bgra(color_img.get_buffer(), color_img.get_size(), color_disp->get_buffer(), width, height);
+            if (!success){
+                fprintf(stderr, "Capture:\t%p\n", capture.get());
+                fprintf(stderr, "Col img:\t%p\n", color_img.handle());
+                std::cerr << std::flush;
+            }
+        } else if (color_img.get_format() == K4A_IMAGE_FORMAT_COLOR_BGRA32) {
+            memcpy(color_disp->get_buffer(), color_img.get_buffer(), color_img.get_size());
+            success = true;
+        } else {
+            // NV12, YUY2 visualization not yet implemented
+        }
+
+        if (success && hflip_color){
+            hflip_bgra(color_disp->get_buffer(), width, height);
+        }
+        color_disp->timing() = timing;
+        color_disp->timing().decode_done = std::chrono::steady_clock::now();
+
+        // Add to display color queues
+        std::shared_ptr<Image<uint8_t>> color_thumb;
+        if (success && thumbnail_preview){
+            color_thumb = make_thumbnail(color_disp->get_buffer(), width, height, 4);
+        }
+        color_disp->timing().queued = std::chrono::steady_clock::now();
+        if (color_thumb != nullptr){
+            color_thumb->timing() = color_disp->timing();
+            color_thumb_queue->try_push(color_thumb);
+        }
+        if (success && color_preview){
+            success &= color_queue->try_push(color_disp);
+            if (!success){
+                record.flags |= FRAME_METADATA_FLAG_PREVIEW_DROPPED;
+                if (metrics != nullptr){
+                    metrics->preview_drops.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+        if (trace_enabled()){
+            trace_record("decode_color", timing.device_index, timing.task_start, color_disp->timing().decode_done);
+            trace_record("queue_color", timing.device_index, color_disp->timing().decode_done, color_disp->timing().queued);
+        }
+        if (success && metrics != nullptr){
+            metrics->latency.record(LATENCY_STAGE_DECODE, timing.task_start, color_disp->timing().decode_done);
+            metrics->latency.record(LATENCY_STAGE_QUEUE_PUSH, color_disp->timing().decode_done, color_disp->timing().queued);
+        }
+        record.decode_usec = elapsed_usec(timing.task_start, color_disp->timing().decode_done);
+        record.queue_push_usec += elapsed_usec(color_disp->timing().decode_done, color_disp->timing().queued);
+    }
+
+    k4a::image ir_img = capture->get_ir_image();
+    if (ir_img.is_valid() && (ir_preview || thumbnail_preview)){
+        unsigned int width = ir_img.get_width_pixels();
+        unsigned int height = ir_img.get_height_pixels();
+        std::shared_ptr<Image<uint8_t>> ir_disp = std::make_shared<Image<uint8_t>>(height, width, 1);
+
+        double expected_pixel_range_max = config.depth_mode == K4A_DEPTH_MODE_PASSIVE_IR ? 100.0 : 1000.0; // hardcoded values are from k4aviewer/k4astaticimageproperties.h
+        auto ir_scale_start = std::chrono::steady_clock::now();
+        scale_ir_to_u8(reinterpret_cast<uint16_t*>(ir_img.get_buffer()), ir_disp->get_buffer(), width, height, expected_pixel_range_max, hflip_ir);
+        ir_disp->timing() = timing;
+        ir_disp->timing().decode_done = std::chrono::steady_clock::now();
+
+        // Add to display ir queues
+        std::shared_ptr<Image<uint8_t>> ir_thumb;
+        if (thumbnail_preview){
+            ir_thumb = make_thumbnail(ir_disp->get_buffer(), width, height, 1);
+        }
+        ir_disp->timing().queued = std::chrono::steady_clock::now();
+        if (ir_thumb != nullptr){
+            ir_thumb->timing() = ir_disp->timing();
+            ir_thumb_queue->try_push(ir_thumb);
+        }
+        if (ir_preview && !ir_queue->try_push(ir_disp)){
+            record.flags |= FRAME_METADATA_FLAG_PREVIEW_DROPPED;
+            if (metrics != nullptr){
+                metrics->preview_drops.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (trace_enabled()){
+            trace_record("scale_ir", timing.device_index, ir_scale_start, ir_disp->timing().decode_done);
+            trace_record("queue_ir", timing.device_index, ir_disp->timing().decode_done, ir_disp->timing().queued);
+        }
+        if (metrics != nullptr){
+            metrics->latency.record(LATENCY_STAGE_DECODE, ir_scale_start, ir_disp->timing().decode_done);
+            metrics->latency.record(LATENCY_STAGE_QUEUE_PUSH, ir_disp->timing().decode_done, ir_disp->timing().queued);
+        }
+        record.ir_scale_usec = elapsed_usec(ir_scale_start, ir_disp->timing().decode_done);
+        record.queue_push_usec += elapsed_usec(ir_disp->timing().decode_done, ir_disp->timing().queued);
+    }
+
+    // Add capture to recording
+    if (recording != nullptr && recording_write_enable){
+        TraceSpan write_span("write_capture", timing.device_index);
+        auto write_start = std::chrono::steady_clock::now();
+        recording->write_capture(*capture);
+        record.write_usec = elapsed_usec(write_start, std::chrono::steady_clock::now());
+        record.flags |= FRAME_METADATA_FLAG_RECORDED;
+    }
+    if (frame_metadata != nullptr){
+        fill_frame_metadata(*capture, &record);
+        record.sequence = timing.sequence;
+        record.pool_wait_usec = elapsed_usec(timing.arrival, timing.task_start);
+        // Same clock check as the capture loop's SDK queue latency
+        std::chrono::steady_clock::time_point host_received(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(record.system_timestamp_nsec)));
+        if (host_received <= timing.arrival && timing.arrival - host_received < std::chrono::seconds(10)){
+            record.sdk_queue_usec = elapsed_usec(host_received, timing.arrival);
+        }
+        frame_metadata->append(record);
+    }
+    if (metrics != nullptr){
+        metrics->tasks_pending.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return;
+}
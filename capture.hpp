@@ -0,0 +1,230 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <mutex>
+
+#include <k4a/k4a.hpp>
+#include <k4arecord/record.hpp>
+
+#include "SPSCQueue.h"
+
+#include "capture_source.hpp"
+#include "recording_sink.hpp"
+#include "stats.hpp"
+#include "frame_metadata.hpp"
+
+// Max number of images to keep in display queues
+#define IMG_QUEUE_SIZE 3
+// Size of each cell in the overview thumbnail atlas
+#define THUMBNAIL_WIDTH 256
+#define THUMBNAIL_HEIGHT 144
+// Streaming start order
+static const std::array DEVICE_STREAMING_START_ORDER {
+    K4A_WIRED_SYNC_MODE_STANDALONE,
+    K4A_WIRED_SYNC_MODE_SUBORDINATE,
+    K4A_WIRED_SYNC_MODE_MASTER
+};
+// Streaming stop order
+static const std::array DEVICE_STREAMING_STOP_ORDER {
+    K4A_WIRED_SYNC_MODE_MASTER,
+    K4A_WIRED_SYNC_MODE_SUBORDINATE,
+    K4A_WIRED_SYNC_MODE_STANDALONE
+};
+// Default streaming config
+static const k4a_device_configuration_t DEFAULT_CONFIG = {
+    K4A_IMAGE_FORMAT_COLOR_MJPG,
+    K4A_COLOR_RESOLUTION_2160P,
+    K4A_DEPTH_MODE_NFOV_UNBINNED,
+    K4A_FRAMES_PER_SECOND_30,
+    false,
+    0,
+    K4A_WIRED_SYNC_MODE_STANDALONE,
+    0,
+    false
+};
+
+static const std::array COLOR_FORMAT_NAMES {"MJPG", "NV12 (No Visual)", "YUY2 (No Visual)", "BGRA32"};
+static const std::array COLOR_RESOLUTION_NAMES {"OFF", "720p", "1080p", "1440p", "1536p", "2160p", "3072p"};
+static const std::array DEPTH_MODE_NAMES {"OFF", "NFOV 2x2 Binned", "NFOV Unbinned", "WFOV 2x2 Binned", "WFOV Unbinned", "Passive IR"};
+static const std::array FPS_MODE_NAMES {"5", "15", "30"};
+static const std::array SYNC_MODE_NAMES {"Standalone", "Master", "Subordinate"};
+
+/***********************************************************
+ *                    HELPERS/UTILITIES                    *
+ ***********************************************************/
+
+template <class T, std::size_t n> static int index_of(const std::array<T, n> arr, const T& target){
+    for (int i = 0; i < arr.size(); i++){
+        if (std::string(arr[i]) == target){
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Match a name from one of the *_NAMES tables, either exactly or by its first word (e.g. "NV12")
+template <std::size_t n> static int parse_name(const std::array<const char*, n>& names, const std::string& value){
+    for (int i = 0; i < n; i++){
+        std::string name = names[i];
+        if (name == value || name.rfind(value + " ", 0) == 0){
+            return i;
+        }
+    }
+    throw std::invalid_argument("Unknown value '" + value + "'");
+}
+
+template <typename T> class Image {
+    private:
+        unsigned int m_width, m_height, m_channels;
+        std::shared_ptr<T[]> m_data_ptr;
+        FrameTiming m_timing;
+    public:
+        Image(int height, int width, int channels) : m_height(height), m_width(width), m_channels(channels){
+            m_data_ptr = std::shared_ptr<T[]>(new T[height * width * channels]);
+        }
+
+        // Getters
+        unsigned int height(){ return m_height; }
+        unsigned int width(){ return m_width; }
+        unsigned int channels(){ return m_channels; }
+        FrameTiming& timing(){ return m_timing; }
+        T* get_buffer(){ return m_data_ptr.get(); }
+        size_t size(){
+            return m_height * m_width * m_channels;
+        }
+
+        T& operator[] (int idx){ return m_data_ptr[idx]; }
+
+        ~Image(){
+            // data destruction handled by shared ptr
+        }
+};
+
+void print_error_info(const std::exception& e, const std::string info_msg = "");
+int get_fps_value(const k4a_fps_t fps);
+// Number of captures per displayed preview frame needed to stay at or below the given display rate (0 = unlimited)
+unsigned int get_preview_decimation(const k4a_fps_t camera_fps, const int preview_fps_limit);
+void remove_trailing_nulls(std::string& s);
+// The SDK logs from its own threads (and the device watcher's), so readers of the message list must hold this
+extern std::mutex k4a_log_mutex;
+void k4a_log_callback(void* context, k4a_log_level_t level, const char* file, int line, const char* msg);
+
+/***********************************************************
+ *                  DEVICES & RECORDINGS                   *
+ ***********************************************************/
+
+// Time taken by each device's open and start_cameras calls, to spot slow USB controllers
+struct DeviceStartupTiming {
+    std::chrono::microseconds open{0};
+    std::chrono::microseconds start{0};
+};
+
+// Devices in the same sync tier are started concurrently; each tier finishes before the next begins. With imu, each
+// device's IMU is started once all cameras are running
+void start_streaming(std::vector<std::unique_ptr<CaptureSource>>& devices, const std::vector<k4a_device_configuration_t>& configs, std::vector<DeviceStartupTiming>* timings = nullptr, const bool imu = false);
+// With close_devices = false the cameras are stopped but the devices stay open for a quicker restart
+void stop_streaming(
+    std::vector<std::unique_ptr<CaptureSource>>& devices,
+    const std::vector<k4a_device_configuration_t>& configs,
+    std::vector<std::unique_ptr<RecordingSink>>& recordings,
+    const bool close_devices = true
+);
+std::vector<std::string> get_available_device_serials(const int num_available_devices);
+// Opens all devices concurrently
+void open_devices(std::vector<int>& device_idxs, std::vector<std::unique_ptr<CaptureSource>>& devices, std::vector<DeviceStartupTiming>* timings = nullptr);
+void load_config_json(
+    const std::string& input_file_path,
+    std::vector<std::string>& available_device_serials,
+    std::vector<std::string>& available_device_nicknames,
+    const std::shared_ptr<bool[]> available_device_checkboxes,
+    bool* identical_configs,
+    std::vector<k4a_device_configuration_t>& configs,
+    bool* recording_enabled,
+    bool* continuous_recording,
+    std::string& recording_save_path,
+    RecordingOptions* recording_options
+);
+void save_config_json(
+    const std::string& output_file_path,
+    const bool identical_configs,
+    const std::vector<std::string>& available_device_serials,
+    const std::vector<std::string>& available_device_nicknames,
+    const std::shared_ptr<bool[]> available_device_checkboxes,
+    const std::vector<k4a_device_configuration_t>& configs,
+    const std::string& recording_save_path,
+    const bool continuous_recording,
+    const RecordingOptions& recording_options
+);
+// In non-continuous mode with recording_options.pretrigger (or .burst), each sink is wrapped in a PretriggerSink (or BurstSink)
+// With recording_options.jpeg_encode_color, uncompressed color is encoded to MJPEG by an outer JpegEncodeSink
+// Devices are spread over recording_save_path and recording_options.extra_save_paths; save_path_idxs receives each
+// device's index into that list (0 = recording_save_path)
+void initialize_recordings(
+    const bool recording_enabled,
+    const bool continuous_recording,
+    std::vector<bool>& recording_write_enables,
+    std::vector<std::unique_ptr<RecordingSink>>& recordings,
+    const std::vector<std::unique_ptr<CaptureSource>>& devices,
+    const std::vector<k4a_device_configuration_t>& configs,
+    const std::vector<int>& device_idxs,
+    const std::vector<std::string>& available_device_serials,
+    const std::vector<std::string>& available_device_nicknames,
+    const std::string& recording_save_path = "",
+    const RecordingOptions& recording_options = RecordingOptions(),
+    std::vector<int>* save_path_idxs = nullptr,
+    std::vector<std::unique_ptr<FrameMetadataWriter>>* frame_metadata = nullptr
+);
+// What to subtract from a device's timestamps to line them up with the other wired-sync devices' (the subordinate delay)
+int64_t get_sync_timestamp_offset_usec(const k4a_device_configuration_t& config);
+// recording_save_path followed by the non-empty extra save paths
+std::vector<std::string> get_save_paths(const std::string& recording_save_path, const RecordingOptions& recording_options);
+
+/***********************************************************
+ *                    FRAME PROCESSING                     *
+ ***********************************************************/
+
+// Decode an MJPEG frame into BGRA; a width/height smaller than the JPEG's selects turbojpeg's DCT scaling
+bool decode_mjpeg_to_bgra(const uint8_t* jpeg_buffer, const size_t jpeg_size, uint8_t* bgra_buffer, const unsigned int width, const unsigned int height);
+// Scale 16-bit IR to 8 bits for display, saturating at expected_pixel_range_max
+void scale_ir_to_u8(const uint16_t* in_buffer, uint8_t* out_buffer, const unsigned int width, const unsigned int height, const double expected_pixel_range_max, const bool hflip);
+void hflip_bgra(uint8_t* bgra_buffer, const unsigned int width, const unsigned int height);
+// Box-filter downscale by an integer factor, writing BGRA pixels (grayscale input is replicated across B, G and R)
+void box_downscale_to_bgra(
+    const uint8_t* src,
+    const unsigned int width,
+    const unsigned int height,
+    const unsigned int channels,
+    const unsigned int factor,
+    uint8_t* dst,
+    const unsigned int dst_stride
+);
+// Downscale an 8-bit BGRA or grayscale image into a letterboxed THUMBNAIL_WIDTH x THUMBNAIL_HEIGHT BGRA thumbnail
+std::shared_ptr<Image<uint8_t>> make_thumbnail(const uint8_t* src, const unsigned int width, const unsigned int height, const unsigned int channels);
+// Decode/convert a capture for display and write it to its recording
+// Display queues may be null when the corresponding preview flag is false; timing (with arrival set) is carried
+// on the display images; pool stage latencies, preview drops and bytes written are recorded into metrics when it is not null,
+// and the capture's sidecar record is appended to frame_metadata when it is not null
+void process_capture(
+    const std::shared_ptr<k4a::capture> capture,
+    const k4a_device_configuration_t& config,
+    rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>* color_queue,
+    rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>* ir_queue,
+    rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>* color_thumb_queue,
+    rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>* ir_thumb_queue,
+    const bool color_preview,
+    const bool ir_preview,
+    const bool thumbnail_preview,
+    const bool hflip_color,
+    const bool hflip_ir,
+    RecordingSink* recording,
+    const bool recording_write_enable,
+    FrameTiming timing,
+    DeviceMetrics* metrics,
+    FrameMetadataWriter* frame_metadata
+);
@@ -0,0 +1,364 @@
+#include <thread>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+
+#include <turbojpeg.h>
+
+#include "capture_source.hpp"
+#include "capture.hpp"
+
+std::pair<int, int> get_color_resolution_size(const k4a_color_resolution_t resolution){
+    switch (resolution){
+        case K4A_COLOR_RESOLUTION_720P:  return {1280, 720};
+        case K4A_COLOR_RESOLUTION_1080P: return {1920, 1080};
+        case K4A_COLOR_RESOLUTION_1440P: return {2560, 1440};
+        case K4A_COLOR_RESOLUTION_1536P: return {2048, 1536};
+        case K4A_COLOR_RESOLUTION_2160P: return {3840, 2160};
+        case K4A_COLOR_RESOLUTION_3072P: return {4096, 3072};
+        default:                         return {0, 0};
+    }
+}
+
+std::pair<int, int> get_depth_mode_size(const k4a_depth_mode_t depth_mode){
+    switch (depth_mode){
+        case K4A_DEPTH_MODE_NFOV_2X2BINNED: return {320, 288};
+        case K4A_DEPTH_MODE_NFOV_UNBINNED:  return {640, 576};
+        case K4A_DEPTH_MODE_WFOV_2X2BINNED: return {512, 512};
+        case K4A_DEPTH_MODE_WFOV_UNBINNED:  return {1024, 1024};
+        case K4A_DEPTH_MODE_PASSIVE_IR:     return {1024, 1024};
+        default:                            return {0, 0};
+    }
+}
+
+std::chrono::microseconds get_capture_device_timestamp(const k4a::capture& capture){
+    for (const k4a::image& img : {capture.get_color_image(), capture.get_depth_image(), capture.get_ir_image()}){
+        if (img.is_valid()){
+            return img.get_device_timestamp();
+        }
+    }
+    return std::chrono::microseconds(0);
+}
+
+std::chrono::nanoseconds get_capture_system_timestamp(const k4a::capture& capture){
+    for (const k4a::image& img : {capture.get_color_image(), capture.get_depth_image(), capture.get_ir_image()}){
+        if (img.is_valid()){
+            return img.get_system_timestamp();
+        }
+    }
+    return std::chrono::nanoseconds(0);
+}
+
+static void release_image_buffer(void* buffer, void* context){
+    delete[] static_cast<uint8_t*>(buffer);
+}
+
+/***********************************************************
+ *                    SYNTHETIC SOURCE                     *
+ ***********************************************************/
+
+// Cheap deterministic noise so frames do not compress unrealistically well
+static uint32_t lcg_next(uint32_t& state){
+    state = state * 1664525u + 1013904223u;
+    return state >> 24;
+}
+
+std::vector<uint8_t> render_color_pattern(const k4a_image_format_t format, const int w, const int h, const int frame, uint32_t& noise_state){
+    // Diagonal gradient with a vertical bar that moves between frames
+    std::vector<uint8_t> bgra(static_cast<size_t>(w) * h * 4);
+    const int bar_x = (w / 4) + frame * (w / (2 * SYNTHETIC_PATTERN_FRAMES));
+    for (int v = 0; v < h; v++){
+        for (int u = 0; u < w; u++){
+            uint8_t* px = &bgra[(static_cast<size_t>(v) * w + u) * 4];
+            bool bar = std::abs(u - bar_x) < w / 32;
+            uint8_t noise = lcg_next(noise_state) & 0x1f;
+            px[0] = bar ? 255 : static_cast<uint8_t>((u * 255) / w) ^ noise;
+            px[1] = bar ? 255 : static_cast<uint8_t>((v * 255) / h) ^ noise;
+            px[2] = bar ? 255 : static_cast<uint8_t>(((u + v) * 255) / (w + h));
+            px[3] = 255;
+        }
+    }
+
+    if (format == K4A_IMAGE_FORMAT_COLOR_MJPG){
+        tjhandle jpeg_compressor = tjInitCompress();
+        unsigned char* jpeg_buffer = nullptr;
+        unsigned long jpeg_size = 0;
+        int result = tjCompress2(jpeg_compressor, bgra.data(), w, 0/*pitch*/, h, TJPF_BGRA, &jpeg_buffer, &jpeg_size, TJSAMP_422, 90, TJFLAG_FASTDCT);
+        if (result != 0){
+            std::string error_str = tjGetErrorStr2(jpeg_compressor);
+            tjDestroy(jpeg_compressor);
+            throw k4a::error("Failed to encode synthetic MJPEG frame: " + error_str);
+        }
+        std::vector<uint8_t> jpeg(jpeg_buffer, jpeg_buffer + jpeg_size);
+        tjFree(jpeg_buffer);
+        tjDestroy(jpeg_compressor);
+        return jpeg;
+    } else if (format == K4A_IMAGE_FORMAT_COLOR_NV12 || format == K4A_IMAGE_FORMAT_COLOR_YUY2){
+        // Luma from the green channel, neutral chroma
+        bool nv12 = format == K4A_IMAGE_FORMAT_COLOR_NV12;
+        std::vector<uint8_t> yuv(nv12 ? static_cast<size_t>(w) * h * 3 / 2 : static_cast<size_t>(w) * h * 2, 128);
+        for (size_t i = 0; i < static_cast<size_t>(w) * h; i++){
+            yuv[nv12 ? i : 2 * i] = bgra[4 * i + 1];
+        }
+        return yuv;
+    }
+    return bgra;
+}
+
+void render_depth_ir_pattern(const int w, const int h, const int frame, uint32_t& noise_state, std::vector<uint16_t>& depth, std::vector<uint16_t>& ir){
+    // Tilted plane around 1.5 m with a moving ripple; IR brightness falls off with depth
+    depth.resize(static_cast<size_t>(w) * h);
+    ir.resize(static_cast<size_t>(w) * h);
+    for (int v = 0; v < h; v++){
+        for (int u = 0; u < w; u++){
+            size_t idx = static_cast<size_t>(v) * w + u;
+            int ripple = ((u + frame * 8) / 16 + v / 16) % 2 == 0 ? 40 : 0;
+            uint16_t d = static_cast<uint16_t>(1200 + (600 * v) / h + ripple + (lcg_next(noise_state) & 0x7));
+            depth[idx] = d;
+            ir[idx] = static_cast<uint16_t>(std::min<int>(1000, 600000 / d + (lcg_next(noise_state) & 0x1f)));
+        }
+    }
+}
+
+void SyntheticSource::render_frames(){
+    m_color_frames.clear();
+    m_depth_frames.clear();
+    m_ir_frames.clear();
+    uint32_t noise_state = std::hash<std::string>()(m_serial);
+
+    for (int f = 0; f < SYNTHETIC_PATTERN_FRAMES; f++){
+        if (m_color_width > 0){
+            m_color_frames.push_back(render_color_pattern(m_config.color_format, m_color_width, m_color_height, f, noise_state));
+        }
+        if (m_depth_width > 0){
+            std::vector<uint16_t> depth, ir;
+            render_depth_ir_pattern(m_depth_width, m_depth_height, f, noise_state, depth, ir);
+            m_depth_frames.push_back(std::move(depth));
+            m_ir_frames.push_back(std::move(ir));
+        }
+    }
+}
+
+k4a::capture SyntheticSource::make_capture(const uint64_t frame_index){
+    k4a::capture capture = k4a::capture::create();
+    const size_t pattern_idx = frame_index % SYNTHETIC_PATTERN_FRAMES;
+
+    // Subordinates are triggered subordinate_delay_off_master_usec after the master
+    const uint64_t color_timestamp_usec = frame_index * m_frame_period.count()
+        + (m_config.wired_sync_mode == K4A_WIRED_SYNC_MODE_SUBORDINATE ? m_config.subordinate_delay_off_master_usec : 0);
+    const uint64_t depth_timestamp_usec = color_timestamp_usec + m_config.depth_delay_off_color_usec;
+    const uint64_t system_timestamp_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>((m_start_time + frame_index * m_frame_period).time_since_epoch()).count();
+
+    if (!m_color_frames.empty()){
+        const std::vector<uint8_t>& frame = m_color_frames[pattern_idx];
+        uint8_t* buffer = new uint8_t[frame.size()];
+        memcpy(buffer, frame.data(), frame.size());
+        int stride = 0;
+        switch (m_config.color_format){
+            case K4A_IMAGE_FORMAT_COLOR_NV12:   stride = m_color_width; break;
+            case K4A_IMAGE_FORMAT_COLOR_YUY2:   stride = m_color_width * 2; break;
+            case K4A_IMAGE_FORMAT_COLOR_BGRA32: stride = m_color_width * 4; break;
+            default: break;
+        }
+        k4a::image color_img = k4a::image::create_from_buffer(m_config.color_format, m_color_width, m_color_height, stride, buffer, frame.size(), release_image_buffer, nullptr);
+        k4a_image_set_device_timestamp_usec(color_img.handle(), color_timestamp_usec);
+        k4a_image_set_system_timestamp_nsec(color_img.handle(), system_timestamp_nsec);
+        k4a_image_set_exposure_usec(color_img.handle(), 8330);
+        k4a_image_set_white_balance(color_img.handle(), 4500);
+        k4a_image_set_iso_speed(color_img.handle(), 400);
+        capture.set_color_image(color_img);
+    }
+
+    if (!m_depth_frames.empty()){
+        const bool passive_ir = m_config.depth_mode == K4A_DEPTH_MODE_PASSIVE_IR;
+        const std::vector<uint16_t>* frames[] = {passive_ir ? nullptr : &m_depth_frames[pattern_idx], &m_ir_frames[pattern_idx]};
+        const k4a_image_format_t formats[] = {K4A_IMAGE_FORMAT_DEPTH16, K4A_IMAGE_FORMAT_IR16};
+        for (int k = 0; k < 2; k++){
+            if (frames[k] == nullptr){
+                continue;
+            }
+            size_t size = frames[k]->size() * sizeof(uint16_t);
+            uint8_t* buffer = new uint8_t[size];
+            memcpy(buffer, frames[k]->data(), size);
+            k4a::image img = k4a::image::create_from_buffer(formats[k], m_depth_width, m_depth_height, m_depth_width * sizeof(uint16_t), buffer, size, release_image_buffer, nullptr);
+            k4a_image_set_device_timestamp_usec(img.handle(), depth_timestamp_usec);
+            k4a_image_set_system_timestamp_nsec(img.handle(), system_timestamp_nsec);
+            if (k == 0){
+                capture.set_depth_image(img);
+            } else {
+                capture.set_ir_image(img);
+            }
+        }
+    }
+
+    capture.set_temperature_c(30.0f + (frame_index % 100) * 0.01f);
+    return capture;
+}
+
+void SyntheticSource::start_cameras(const k4a_device_configuration_t* config){
+    m_config = *config;
+    std::tie(m_color_width, m_color_height) = get_color_resolution_size(m_config.color_resolution);
+    if (m_color_width > 0 && m_color_width_override > 0){
+        m_color_width = m_color_width_override;
+        m_color_height = m_color_height_override;
+    }
+    std::tie(m_depth_width, m_depth_height) = get_depth_mode_size(m_config.depth_mode);
+    render_frames();
+
+    m_frame_period = std::chrono::microseconds(1000000 / get_fps_value(m_config.camera_fps));
+    m_frame_index = 0;
+    m_dropped_frames = 0;
+    m_start_time = std::chrono::steady_clock::now();
+    m_started = true;
+}
+
+void SyntheticSource::stop_cameras(){
+    m_started = false;
+    m_color_frames.clear();
+    m_depth_frames.clear();
+    m_ir_frames.clear();
+}
+
+bool SyntheticSource::get_capture(k4a::capture* capture, std::chrono::milliseconds timeout){
+    if (!m_started){
+        throw k4a::error("Synthetic source '" + m_serial + "' has not been started");
+    }
+    auto due = m_start_time + m_frame_index * m_frame_period;
+    auto now = std::chrono::steady_clock::now();
+    if (due > now){
+        if (due - now > timeout){
+            std::this_thread::sleep_for(timeout);
+            return false;
+        }
+        std::this_thread::sleep_until(due);
+    } else if (now - due > 2 * m_frame_period){
+        // Consumer fell behind; like the device, skip the frames it missed
+        uint64_t missed = (now - due) / m_frame_period;
+        m_frame_index += missed;
+        m_dropped_frames += missed;
+    }
+    *capture = make_capture(m_frame_index++);
+    return true;
+}
+
+void SyntheticSource::start_imu(){
+    if (!m_started){
+        throw k4a::error("Synthetic source '" + m_serial + "' must be started before its IMU");
+    }
+    m_imu_index = 0;
+    m_imu_start_time = m_start_time;
+    m_imu_started = true;
+}
+
+bool SyntheticSource::get_imu_sample(k4a_imu_sample_t* sample, std::chrono::milliseconds timeout){
+    if (!m_imu_started){
+        throw k4a::error("Synthetic source '" + m_serial + "' IMU has not been started");
+    }
+    const auto period = std::chrono::microseconds(1000000 / SYNTHETIC_IMU_RATE_HZ);
+    auto due = m_imu_start_time + m_imu_index * period;
+    auto now = std::chrono::steady_clock::now();
+    if (due > now){
+        if (due - now > timeout){
+            std::this_thread::sleep_for(timeout);
+            return false;
+        }
+        std::this_thread::sleep_until(due);
+    }
+    // Device timestamps on the same clock as the frames' (which start at 0)
+    const uint64_t timestamp_usec = m_imu_index * period.count();
+    const float t = timestamp_usec / 1e6f;
+    sample->temperature = 30.0f;
+    sample->acc_sample.xyz.x = 0.2f * std::sin(t);
+    sample->acc_sample.xyz.y = 0.2f * std::cos(t);
+    sample->acc_sample.xyz.z = -9.81f;
+    sample->acc_timestamp_usec = timestamp_usec;
+    sample->gyro_sample.xyz.x = 0.2f * std::cos(t);
+    sample->gyro_sample.xyz.y = -0.2f * std::sin(t);
+    sample->gyro_sample.xyz.z = 0.0f;
+    sample->gyro_timestamp_usec = timestamp_usec;
+    m_imu_index++;
+    return true;
+}
+
+/***********************************************************
+ *                     PLAYBACK SOURCE                     *
+ ***********************************************************/
+
+k4a_device_configuration_t PlaybackSource::get_device_configuration(){
+    k4a_record_configuration_t record_config = m_playback.get_record_configuration();
+    k4a_device_configuration_t config = DEFAULT_CONFIG;
+    config.color_format = record_config.color_format;
+    config.color_resolution = record_config.color_track_enabled ? record_config.color_resolution : K4A_COLOR_RESOLUTION_OFF;
+    config.depth_mode = (record_config.depth_track_enabled || record_config.ir_track_enabled) ? record_config.depth_mode : K4A_DEPTH_MODE_OFF;
+    config.camera_fps = record_config.camera_fps;
+    config.depth_delay_off_color_usec = record_config.depth_delay_off_color_usec;
+    config.wired_sync_mode = record_config.wired_sync_mode;
+    config.subordinate_delay_off_master_usec = record_config.subordinate_delay_off_master_usec;
+    return config;
+}
+
+std::string PlaybackSource::get_serialnum(){
+    std::string serial;
+    if (!m_playback.get_tag("K4A_DEVICE_SERIAL_NUMBER", &serial) || serial.empty()){
+        serial = m_path;
+    }
+    return serial;
+}
+
+void PlaybackSource::start_cameras(const k4a_device_configuration_t* config){
+    m_playback.seek_timestamp(std::chrono::microseconds(0), K4A_PLAYBACK_SEEK_BEGIN);
+    m_frame_period = std::chrono::microseconds(1000000 / get_fps_value(get_device_configuration().camera_fps));
+    m_first_timestamp = std::chrono::microseconds(-1);
+    m_loop_offset = std::chrono::microseconds(0);
+    m_pending.reset();
+    m_start_time = std::chrono::steady_clock::now();
+    m_started = true;
+}
+
+void PlaybackSource::stop_cameras(){
+    m_started = false;
+    m_pending.reset();
+}
+
+bool PlaybackSource::get_capture(k4a::capture* capture, std::chrono::milliseconds timeout){
+    if (!m_started){
+        throw k4a::error("Playback of '" + m_path + "' has not been started");
+    }
+
+    if (!m_pending.is_valid()){
+        if (!m_playback.get_next_capture(&m_pending)){
+            // End of file: loop, keeping device timestamps increasing
+            m_loop_offset += m_last_timestamp - m_first_timestamp + m_frame_period;
+            m_playback.seek_timestamp(std::chrono::microseconds(0), K4A_PLAYBACK_SEEK_BEGIN);
+            if (!m_playback.get_next_capture(&m_pending)){
+                throw k4a::error("Recording '" + m_path + "' contains no captures");
+            }
+        }
+        std::chrono::microseconds timestamp = get_capture_device_timestamp(m_pending);
+        if (m_first_timestamp.count() < 0){
+            m_first_timestamp = timestamp;
+        }
+        m_last_timestamp = timestamp;
+        if (m_loop_offset.count() > 0){
+            for (k4a::image img : {m_pending.get_color_image(), m_pending.get_depth_image(), m_pending.get_ir_image()}){
+                if (img.is_valid()){
+                    img.set_timestamp(img.get_device_timestamp() + m_loop_offset);
+                }
+            }
+        }
+    }
+
+    if (m_realtime){
+        auto due = m_start_time + (m_last_timestamp - m_first_timestamp + m_loop_offset);
+        auto now = std::chrono::steady_clock::now();
+        if (due - now > timeout){
+            std::this_thread::sleep_for(timeout);
+            return false;
+        }
+        std::this_thread::sleep_until(due);
+    }
+
+    *capture = m_pending;
+    m_pending.reset();
+    return true;
+}
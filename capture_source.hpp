@@ -0,0 +1,146 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <atomic>
+
+#include <k4a/k4a.hpp>
+#include <k4arecord/playback.hpp>
+
+// Number of distinct frames a synthetic source cycles through
+#define SYNTHETIC_PATTERN_FRAMES 2
+// Sample rate of a synthetic source's IMU (the device's is 1.6 kHz)
+#define SYNTHETIC_IMU_RATE_HZ 1600
+
+// Image dimensions for each k4a color resolution / depth mode ({0, 0} when off)
+std::pair<int, int> get_color_resolution_size(const k4a_color_resolution_t resolution);
+std::pair<int, int> get_depth_mode_size(const k4a_depth_mode_t depth_mode);
+// Device timestamp of the first valid image in a capture (color, then depth, then IR)
+std::chrono::microseconds get_capture_device_timestamp(const k4a::capture& capture);
+// Host system timestamp (when the SDK received the frame) of the same image
+std::chrono::nanoseconds get_capture_system_timestamp(const k4a::capture& capture);
+// Synthetic test patterns, also used by the benchmarks; frame selects one of SYNTHETIC_PATTERN_FRAMES variants
+// Color is returned in the given format (MJPG is encoded with turbojpeg); depth/IR are 16-bit
+std::vector<uint8_t> render_color_pattern(const k4a_image_format_t format, const int width, const int height, const int frame, uint32_t& noise_state);
+void render_depth_ir_pattern(const int width, const int height, const int frame, uint32_t& noise_state, std::vector<uint16_t>& depth, std::vector<uint16_t>& ir);
+
+/***********************************************************
+ *                     CAPTURE SOURCES                     *
+ ***********************************************************/
+
+// Anything that produces k4a captures; mirrors the parts of the k4a::device API used by the pipeline
+class CaptureSource {
+    public:
+        virtual ~CaptureSource() = default;
+
+        virtual std::string get_serialnum() = 0;
+        virtual void start_cameras(const k4a_device_configuration_t* config) = 0;
+        virtual void stop_cameras() = 0;
+        // Returns false on timeout; throws k4a::error on failure
+        virtual bool get_capture(k4a::capture* capture, std::chrono::milliseconds timeout) = 0;
+
+        // IMU (accelerometer + gyroscope, ~1.6 kHz); start_imu requires the cameras to be running
+        virtual bool has_imu(){ return false; }
+        virtual void start_imu(){}
+        virtual void stop_imu(){}
+        // Returns false on timeout; throws k4a::error on failure
+        virtual bool get_imu_sample(k4a_imu_sample_t* sample, std::chrono::milliseconds timeout){ return false; }
+
+        // Device handle passed to k4a::record::create; sources without hardware return an invalid (null) device,
+        // which k4arecord accepts for user-generated data
+        virtual const k4a::device& get_device(){ return m_null_device; }
+
+    private:
+        k4a::device m_null_device;
+};
+
+// A physical Azure Kinect
+class DeviceSource : public CaptureSource {
+    private:
+        k4a::device m_device;
+    public:
+        DeviceSource(const uint32_t index) : m_device(k4a::device::open(index)) {}
+
+        std::string get_serialnum() override { return m_device.get_serialnum(); }
+        void start_cameras(const k4a_device_configuration_t* config) override { m_device.start_cameras(config); }
+        void stop_cameras() override { m_device.stop_cameras(); }
+        bool get_capture(k4a::capture* capture, std::chrono::milliseconds timeout) override { return m_device.get_capture(capture, timeout); }
+        bool has_imu() override { return true; }
+        void start_imu() override { m_device.start_imu(); }
+        void stop_imu() override { m_device.stop_imu(); }
+        bool get_imu_sample(k4a_imu_sample_t* sample, std::chrono::milliseconds timeout) override { return m_device.get_imu_sample(sample, timeout); }
+        const k4a::device& get_device() override { return m_device; }
+};
+
+// Generates captures at the configured rate without hardware, for benchmarking and testing the pipeline
+// Color (MJPG, NV12, YUY2 or BGRA32) and 16-bit depth/IR frames are pre-rendered on start_cameras and copied
+// into fresh k4a images per capture; device timestamps advance by exactly one frame period, offset by the
+// configured depth and subordinate delays. Frames the consumer is too slow to collect are dropped, as on a device.
+// IMU samples (gravity plus a slow wobble) are generated the same way at SYNTHETIC_IMU_RATE_HZ.
+class SyntheticSource : public CaptureSource {
+    private:
+        std::string m_serial;
+        k4a_device_configuration_t m_config;
+        bool m_started = false;
+        int m_color_width = 0, m_color_height = 0;
+        int m_color_width_override = 0, m_color_height_override = 0;
+        int m_depth_width = 0, m_depth_height = 0;
+        std::vector<std::vector<uint8_t>> m_color_frames;
+        std::vector<std::vector<uint16_t>> m_depth_frames;
+        std::vector<std::vector<uint16_t>> m_ir_frames;
+        std::chrono::steady_clock::time_point m_start_time;
+        std::chrono::microseconds m_frame_period;
+        uint64_t m_frame_index = 0;
+        std::atomic<uint64_t> m_dropped_frames = 0;
+        std::atomic<bool> m_imu_started = false;
+        std::chrono::steady_clock::time_point m_imu_start_time;
+        uint64_t m_imu_index = 0;
+
+        void render_frames();
+        k4a::capture make_capture(const uint64_t frame_index);
+    public:
+        SyntheticSource(const std::string& serial) : m_serial(serial), m_config() {}
+
+        // Use a color size other than the one implied by the configured color resolution
+        void set_color_size(const int width, const int height){
+            m_color_width_override = width;
+            m_color_height_override = height;
+        }
+        uint64_t get_dropped_frames(){ return m_dropped_frames; }
+
+        std::string get_serialnum() override { return m_serial; }
+        void start_cameras(const k4a_device_configuration_t* config) override;
+        void stop_cameras() override;
+        bool get_capture(k4a::capture* capture, std::chrono::milliseconds timeout) override;
+        bool has_imu() override { return true; }
+        void start_imu() override;
+        void stop_imu() override { m_imu_started = false; }
+        bool get_imu_sample(k4a_imu_sample_t* sample, std::chrono::milliseconds timeout) override;
+};
+
+// Replays an existing recording, paced by its device timestamps (or as fast as possible), looping at the end
+class PlaybackSource : public CaptureSource {
+    private:
+        std::string m_path;
+        k4a::playback m_playback;
+        bool m_realtime;
+        bool m_started = false;
+        std::chrono::microseconds m_first_timestamp{-1};
+        std::chrono::microseconds m_loop_offset{0};
+        std::chrono::microseconds m_last_timestamp{0};
+        std::chrono::microseconds m_frame_period{0};
+        std::chrono::steady_clock::time_point m_start_time;
+        k4a::capture m_pending;
+    public:
+        PlaybackSource(const std::string& path, const bool realtime = true) : m_path(path), m_playback(k4a::playback::open(path.c_str())), m_realtime(realtime) {}
+
+        // The configuration the file was recorded with; use it when starting this source
+        k4a_device_configuration_t get_device_configuration();
+
+        std::string get_serialnum() override;
+        void start_cameras(const k4a_device_configuration_t* config) override;
+        void stop_cameras() override;
+        bool get_capture(k4a::capture* capture, std::chrono::milliseconds timeout) override;
+};
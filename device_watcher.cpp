@@ -0,0 +1,110 @@
+#include <iostream>
+
+#include <k4a/k4a.hpp>
+
+#include "device_watcher.hpp"
+#include "trace.hpp"
+
+DeviceWatcher::DeviceWatcher() : m_serials(std::make_shared<const std::vector<std::string>>()){
+    m_thread = std::thread(&DeviceWatcher::watch_loop, this);
+}
+
+DeviceWatcher::~DeviceWatcher(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+std::shared_ptr<const std::vector<std::string>> DeviceWatcher::get_serials(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_serials;
+}
+
+void DeviceWatcher::pause(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_paused = true;
+    }
+    std::lock_guard<std::mutex> scan_lock(m_scan_mutex);
+}
+
+void DeviceWatcher::resume(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_paused = false;
+        m_wake = true;
+    }
+    m_cv.notify_all();
+}
+
+void DeviceWatcher::rescan(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_rescan = true;
+        m_wake = true;
+    }
+    m_cv.notify_all();
+}
+
+void DeviceWatcher::watch_loop(){
+    trace_set_thread_name("Device Watcher");
+    std::vector<std::string> serials;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop){
+        if (!m_paused){
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> scan_lock(m_scan_mutex);
+                // pause() may have been called while the lock was released
+                lock.lock();
+                bool paused = m_paused;
+                if (m_rescan && !paused){
+                    serials.clear();
+                    m_rescan = false;
+                }
+                lock.unlock();
+                if (!paused){
+                    scan(serials);
+                }
+            }
+            lock.lock();
+        }
+        m_cv.wait_for(lock, std::chrono::milliseconds(DEVICE_WATCHER_POLL_MSEC), [this]{ return m_stop || m_wake; });
+        m_wake = false;
+    }
+}
+
+void DeviceWatcher::scan(std::vector<std::string>& serials){
+    const int num_installed = k4a::device::get_installed_count();
+    if (num_installed == serials.size()){
+        return;
+    }
+
+    TraceSpan scan_span("enumerate_devices");
+    // New indices (and ones that could not be read last time) have empty serials and are the only ones opened
+    if (num_installed < serials.size()){
+        serials.clear();
+    }
+    serials.resize(num_installed);
+    for (int i = 0; i < num_installed; i++){
+        if (!serials[i].empty()){
+            continue;
+        }
+        try {
+            k4a::device device = k4a::device::open(i);
+            serials[i] = device.get_serialnum();
+            device.close();
+        } catch (k4a::error& e){
+            serials[i].clear();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (*m_serials != serials){
+        m_serials = std::make_shared<const std::vector<std::string>>(serials);
+        m_generation.fetch_add(1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+// Interval between checks of the installed device count
+#define DEVICE_WATCHER_POLL_MSEC 500
+
+/***********************************************************
+ *                     DEVICE WATCHER                      *
+ ***********************************************************/
+
+// Polls k4a::device::get_installed_count() on a background thread and keeps a cached list of serial numbers.
+// When devices are added, only the new indices are opened to read their serials; a removal re-reads every
+// index, since the remaining devices may have been renumbered. Devices that cannot be opened (e.g. in use by
+// another program) are listed with an empty serial and retried the next time the count changes.
+class DeviceWatcher {
+    private:
+        std::mutex m_scan_mutex;        // held while enumerating, so pause() can wait for a scan in progress
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_stop = false;
+        bool m_paused = false;
+        bool m_wake = false;            // set by resume()/rescan() to scan without waiting for the next poll
+        bool m_rescan = false;
+        std::shared_ptr<const std::vector<std::string>> m_serials;
+        std::atomic<uint64_t> m_generation{0};
+        std::thread m_thread;
+
+        void watch_loop();
+        void scan(std::vector<std::string>& serials);
+    public:
+        DeviceWatcher();
+        ~DeviceWatcher();
+        DeviceWatcher(const DeviceWatcher&) = delete;
+        DeviceWatcher& operator=(const DeviceWatcher&) = delete;
+
+        // Incremented whenever a new device list is published; cheap to check every UI frame
+        uint64_t get_generation() const { return m_generation.load(std::memory_order_acquire); }
+        std::shared_ptr<const std::vector<std::string>> get_serials();
+
+        // Stop enumerating (returns once any scan in progress has finished), e.g. while devices are open for streaming
+        void pause();
+        void resume();
+        // Forget the cached serials and re-read every index, e.g. after closing devices that were held open during a scan
+        void rescan();
+};
@@ -0,0 +1,67 @@
+#include <iostream>
+#include <cstring>
+
+#include "frame_metadata.hpp"
+#include "capture_source.hpp"
+#include "trace.hpp"
+
+FrameMetadataWriter::FrameMetadataWriter(const std::string& path, const std::string& serial, const k4a_fps_t camera_fps, const std::chrono::seconds start_time)
+    : m_path(path), m_file(path, std::ios::binary | std::ios::trunc)
+{
+    if (!m_file){
+        throw k4a::error("Failed to create frame metadata file '" + path + "'");
+    }
+    FrameMetadataHeader header = {};
+    std::memcpy(header.magic, FRAME_METADATA_MAGIC, sizeof(header.magic));
+    header.version = FRAME_METADATA_VERSION;
+    header.header_size = sizeof(FrameMetadataHeader);
+    header.record_size = sizeof(FrameMetadataRecord);
+    header.camera_fps = camera_fps;
+    header.start_time_sec = start_time.count();
+    std::strncpy(header.serial, serial.c_str(), sizeof(header.serial) - 1);
+    if (!m_file.write(reinterpret_cast<const char*>(&header), sizeof(header))){
+        throw k4a::error("Failed to write frame metadata header to '" + path + "'");
+    }
+    m_batch.reserve(FRAME_METADATA_BATCH_RECORDS);
+}
+
+FrameMetadataWriter::~FrameMetadataWriter(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    write_batch();
+}
+
+void FrameMetadataWriter::append(const FrameMetadataRecord& record){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_batch.push_back(record);
+    if (m_batch.size() >= FRAME_METADATA_BATCH_RECORDS){
+        write_batch();
+    }
+}
+
+// Called with m_mutex held; the batch is small enough that other pool threads wait at most one buffered write
+void FrameMetadataWriter::write_batch(){
+    if (m_batch.empty()){
+        return;
+    }
+    TraceSpan write_span("frame_metadata_write");
+    if (!m_failed && !m_file.write(reinterpret_cast<const char*>(m_batch.data()), m_batch.size() * sizeof(FrameMetadataRecord))){
+        // Reported once; the recording itself carries on
+        m_failed = true;
+        std::cerr << "[ERROR] Failed to write frame metadata to '" << m_path << "'; no more records will be written" << std::endl;
+    }
+    m_batch.clear();
+}
+
+void fill_frame_metadata(const k4a::capture& capture, FrameMetadataRecord* record){
+    k4a::image color_img = capture.get_color_image();
+    record->device_timestamp_usec = get_capture_device_timestamp(capture).count();
+    record->system_timestamp_nsec = get_capture_system_timestamp(capture).count();
+    if (color_img.is_valid()){
+        record->exposure_usec = color_img.get_exposure().count();
+        record->white_balance = color_img.get_white_balance();
+        record->flags |= FRAME_METADATA_FLAG_COLOR;
+    }
+    record->flags |= capture.get_depth_image().is_valid() ? FRAME_METADATA_FLAG_DEPTH : 0;
+    record->flags |= capture.get_ir_image().is_valid() ? FRAME_METADATA_FLAG_IR : 0;
+    record->temperature_c = capture.get_temperature_c();
+}
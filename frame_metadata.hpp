@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+#include <k4a/k4a.hpp>
+
+#define FRAME_METADATA_EXTENSION ".frames"
+#define FRAME_METADATA_VERSION 1
+// Records buffered between writes (72 KiB, about 35 s of a 30 fps device)
+#define FRAME_METADATA_BATCH_RECORDS 1024
+
+/***********************************************************
+ *                  FRAME METADATA SIDECAR                 *
+ ***********************************************************/
+
+// Layout (little-endian): a FrameMetadataHeader, then one FrameMetadataRecord per capture until the end of the file, so
+// the file can be memory-mapped and read as an array of (file size - header_size) / record_size records. Records are
+// appended as pool threads finish with captures, so they are only roughly in sequence order; sort by sequence if needed.
+// Readers should use header_size and record_size from the header, so that later versions can append fields.
+
+static const char FRAME_METADATA_MAGIC[8] = {'K', '4', 'A', 'F', 'R', 'A', 'M', 'E'};
+
+struct FrameMetadataHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;           // offset of the first record
+    uint32_t record_size;
+    int32_t camera_fps;
+    int64_t start_time_sec;         // Unix time the recording was started
+    char serial[32];
+};
+
+enum FrameMetadataFlags {
+    FRAME_METADATA_FLAG_RECORDED = 1 << 0,          // written to the recording (not only previewed or discarded)
+    FRAME_METADATA_FLAG_PREVIEW_DROPPED = 1 << 1,   // a preview image was discarded because the display queue was full
+    FRAME_METADATA_FLAG_COLOR = 1 << 2,             // capture has each image
+    FRAME_METADATA_FLAG_DEPTH = 1 << 3,
+    FRAME_METADATA_FLAG_IR = 1 << 4
+};
+
+// Stage durations are in microseconds and 0 for stages the capture skipped; see LatencyStage for what each covers
+struct FrameMetadataRecord {
+    uint64_t sequence;              // captures received from the device since streaming started (frames it dropped are not counted)
+    int64_t device_timestamp_usec;  // color if present, else depth/IR
+    int64_t system_timestamp_nsec;  // host time the SDK received the capture
+    int64_t exposure_usec;          // color only
+    uint32_t white_balance;         // color only, in Kelvin
+    float temperature_c;            // NaN when the device did not report one
+    uint32_t flags;                 // FrameMetadataFlags
+    uint32_t sdk_queue_usec;
+    uint32_t pool_wait_usec;
+    uint32_t decode_usec;           // color decode or copy for preview
+    uint32_t ir_scale_usec;
+    uint32_t queue_push_usec;       // thumbnailing and pushing to the display queues, color and IR together
+    uint32_t write_usec;            // RecordingSink::write_capture
+    uint32_t reserved;              // zero; pads the record to a multiple of 8 bytes
+};
+static_assert(sizeof(FrameMetadataHeader) == 64, "FrameMetadataHeader layout changed");
+static_assert(sizeof(FrameMetadataRecord) == 72, "FrameMetadataRecord layout changed");
+
+// One device's sidecar. append() is called from the pool threads that write captures to the recording; records are
+// collected in memory and written FRAME_METADATA_BATCH_RECORDS at a time, so most calls only copy one record under a lock.
+class FrameMetadataWriter {
+    private:
+        std::string m_path;
+        std::mutex m_mutex;
+        std::ofstream m_file;
+        std::vector<FrameMetadataRecord> m_batch;
+        bool m_failed = false;
+
+        void write_batch();
+    public:
+        // Throws k4a::error if the file cannot be created
+        FrameMetadataWriter(const std::string& path, const std::string& serial, const k4a_fps_t camera_fps, const std::chrono::seconds start_time);
+        // Writes the records still buffered
+        ~FrameMetadataWriter();
+        FrameMetadataWriter(const FrameMetadataWriter&) = delete;
+        FrameMetadataWriter& operator=(const FrameMetadataWriter&) = delete;
+
+        void append(const FrameMetadataRecord& record);
+        std::string get_path() const { return m_path; }
+};
+
+// Fills the fields that come from the capture itself (timestamps, exposure, white balance, temperature, image flags)
+void fill_frame_metadata(const k4a::capture& capture, FrameMetadataRecord* record);
@@ -0,0 +1,126 @@
+#include <algorithm>
+
+#include "frameset_sync.hpp"
+#include "capture.hpp"
+
+FramesetSynchronizer::FramesetSynchronizer(const std::vector<k4a_device_configuration_t>& configs, const size_t ring_size){
+    int64_t max_delay_usec = 0;
+    int64_t frame_period_usec = 0;
+    for (const k4a_device_configuration_t& config : configs){
+        bool member = config.wired_sync_mode != K4A_WIRED_SYNC_MODE_STANDALONE;
+        bool subordinate = config.wired_sync_mode == K4A_WIRED_SYNC_MODE_SUBORDINATE;
+        m_members.push_back(member);
+        m_offsets.emplace_back(subordinate ? config.subordinate_delay_off_master_usec : 0);
+        if (subordinate){
+            max_delay_usec = std::max<int64_t>(max_delay_usec, config.subordinate_delay_off_master_usec);
+        }
+        if (member && frame_period_usec == 0){
+            frame_period_usec = 1000000 / get_fps_value(config.camera_fps);
+        }
+    }
+    int64_t tolerance_usec = std::max<int64_t>(max_delay_usec, FRAMESET_MIN_TOLERANCE_USEC);
+    if (frame_period_usec > 0){
+        tolerance_usec = std::min<int64_t>(tolerance_usec, frame_period_usec / 2 - 1);
+    }
+    m_tolerance = std::chrono::microseconds(tolerance_usec);
+    m_max_wait = std::chrono::microseconds(FRAMESET_MAX_WAIT_PERIODS * frame_period_usec);
+
+    m_rings.resize(configs.size());
+    for (Ring& ring : m_rings){
+        ring.entries.resize(std::max<size_t>(1, ring_size));
+    }
+    m_latest.assign(configs.size(), std::chrono::microseconds::min());
+}
+
+bool FramesetSynchronizer::is_active() const {
+    return std::count(m_members.begin(), m_members.end(), true) >= 2;
+}
+
+void FramesetSynchronizer::set_consumer(std::function<void(const Frameset&)> consumer){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_consumer = std::move(consumer);
+}
+
+void FramesetSynchronizer::push(const int device, const std::shared_ptr<k4a::capture>& capture, const FrameTiming& timing){
+    if (device < 0 || device >= m_members.size() || !m_members[device] || !is_active()){
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Ring& ring = m_rings[device];
+    if (ring.size == ring.entries.size()){
+        ring.pop();
+        m_evicted.fetch_add(1, std::memory_order_relaxed);
+    }
+    std::chrono::microseconds timestamp = timing.device_timestamp - m_offsets[device];
+    ring.entries[(ring.head + ring.size) % ring.entries.size()] = {timestamp, capture, timing};
+    ring.size++;
+    m_latest[device] = std::max(m_latest[device], timestamp);
+    assemble(false);
+}
+
+void FramesetSynchronizer::flush(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    assemble(true);
+}
+
+void FramesetSynchronizer::assemble(const bool flush){
+    const int num_devices = m_members.size();
+    const int num_members = std::count(m_members.begin(), m_members.end(), true);
+    while (true){
+        // The oldest pending capture anchors the next frameset
+        bool any_pending = false;
+        std::chrono::microseconds reference = std::chrono::microseconds::max();
+        std::chrono::microseconds newest = std::chrono::microseconds::min();
+        for (int d = 0; d < num_devices; d++){
+            if (m_rings[d].size > 0){
+                reference = std::min(reference, m_rings[d].front().timestamp);
+                any_pending = true;
+            }
+            newest = std::max(newest, m_latest[d]);
+        }
+        if (!any_pending){
+            return;
+        }
+
+        // A member without a match is missing once it has delivered something newer; until then it may still arrive
+        int num_waiting = 0;
+        for (int d = 0; d < num_devices; d++){
+            if (!m_members[d]){
+                continue;
+            }
+            bool matched = m_rings[d].size > 0 && m_rings[d].front().timestamp <= reference + m_tolerance;
+            if (!matched && m_latest[d] <= reference + m_tolerance){
+                num_waiting++;
+            }
+        }
+        if (num_waiting > 0 && !flush && newest < reference + m_max_wait){
+            return;
+        }
+
+        Frameset frameset;
+        frameset.index = m_next_index++;
+        frameset.timestamp = reference;
+        frameset.captures.resize(num_devices);
+        frameset.timings.resize(num_devices);
+        std::chrono::microseconds latest_member = reference;
+        int num_matched = 0;
+        for (int d = 0; d < num_devices; d++){
+            if (m_rings[d].size > 0 && m_rings[d].front().timestamp <= reference + m_tolerance){
+                Entry& entry = m_rings[d].front();
+                frameset.captures[d] = std::move(entry.capture);
+                frameset.timings[d] = entry.timing;
+                latest_member = std::max(latest_member, entry.timestamp);
+                m_rings[d].pop();
+                num_matched++;
+            }
+        }
+        frameset.num_missing = num_members - num_matched;
+        frameset.spread = latest_member - reference;
+
+        (frameset.num_missing == 0 ? m_complete : m_partial).fetch_add(1, std::memory_order_relaxed);
+        m_last_spread_usec.store(frameset.spread.count(), std::memory_order_relaxed);
+        if (m_consumer){
+            m_consumer(frameset);
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+#include <k4a/k4a.hpp>
+
+#include "stats.hpp"
+
+// Captures kept per device while waiting for the rest of a frameset; the oldest is evicted when full
+#define FRAMESET_RING_SIZE 8
+// Lower bound on the matching tolerance, covering timestamp jitter between synced devices
+#define FRAMESET_MIN_TOLERANCE_USEC 500
+// Frame periods to wait for a late device before emitting a partial frameset
+#define FRAMESET_MAX_WAIT_PERIODS 2
+
+/***********************************************************
+ *                  FRAMESET SYNCHRONIZER                  *
+ ***********************************************************/
+
+// Captures from wired-synced devices that were exposed together
+// Non-member (standalone) devices and devices missing from a partial frameset have a null capture
+struct Frameset {
+    uint64_t index = 0;
+    std::chrono::microseconds timestamp{0};     // master-relative time of the set (earliest member)
+    std::vector<std::shared_ptr<k4a::capture>> captures;
+    std::vector<FrameTiming> timings;
+    int num_missing = 0;                        // member devices without a capture in this set
+    std::chrono::microseconds spread{0};        // latest minus earliest member timestamp
+};
+
+// Matches captures from master/subordinate devices by device timestamp. Each subordinate's timestamps are shifted
+// back by its subordinate_delay_off_master_usec, and captures within the tolerance of the oldest pending capture form
+// a frameset. The tolerance is the largest subordinate delay (so matching still works if the device already compensates
+// for it), at least FRAMESET_MIN_TOLERANCE_USEC and below half a frame period. A set is emitted complete as soon as
+// every member matched, or partial once each missing member has moved past it or FRAMESET_MAX_WAIT_PERIODS have passed.
+// push() may be called from several capture threads; the consumer runs on the pushing thread and should return quickly.
+class FramesetSynchronizer {
+    private:
+        struct Entry {
+            std::chrono::microseconds timestamp;
+            std::shared_ptr<k4a::capture> capture;
+            FrameTiming timing;
+        };
+        struct Ring {
+            std::vector<Entry> entries;
+            size_t head = 0;
+            size_t size = 0;
+            Entry& front(){ return entries[head]; }
+            void pop(){ entries[head].capture.reset(); head = (head + 1) % entries.size(); size--; }
+        };
+
+        std::vector<bool> m_members;
+        std::vector<std::chrono::microseconds> m_offsets;
+        std::chrono::microseconds m_tolerance;
+        std::chrono::microseconds m_max_wait;
+        std::mutex m_mutex;
+        std::vector<Ring> m_rings;
+        std::vector<std::chrono::microseconds> m_latest;
+        std::function<void(const Frameset&)> m_consumer;
+        uint64_t m_next_index = 0;
+
+        std::atomic<uint64_t> m_complete{0};
+        std::atomic<uint64_t> m_partial{0};
+        std::atomic<uint64_t> m_evicted{0};
+        std::atomic<int64_t> m_last_spread_usec{0};
+
+        void assemble(const bool flush);
+    public:
+        FramesetSynchronizer(const std::vector<k4a_device_configuration_t>& configs, const size_t ring_size = FRAMESET_RING_SIZE);
+
+        // True when at least two devices are wired-synced; otherwise push() ignores every capture
+        bool is_active() const;
+        bool is_member(const int device) const { return m_members[device]; }
+        std::chrono::microseconds get_tolerance() const { return m_tolerance; }
+
+        void set_consumer(std::function<void(const Frameset&)> consumer);
+        void push(const int device, const std::shared_ptr<k4a::capture>& capture, const FrameTiming& timing);
+        // Emit everything still pending as (partial) framesets, e.g. before stopping
+        void flush();
+
+        uint64_t get_complete_count() const { return m_complete.load(std::memory_order_relaxed); }
+        uint64_t get_partial_count() const { return m_partial.load(std::memory_order_relaxed); }
+        uint64_t get_evicted_count() const { return m_evicted.load(std::memory_order_relaxed); }
+        std::chrono::microseconds get_last_spread() const { return std::chrono::microseconds(m_last_spread_usec.load(std::memory_order_relaxed)); }
+};
@@ -0,0 +1,450 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include <k4a/k4a.hpp>
+#include <k4arecord/record.hpp>
+
+#include "BS_thread_pool.hpp"
+
+#include "capture.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
+#include "timelapse.hpp"
+#include "imu.hpp"
+#include "frameset_sync.hpp"
+
+// Headless recorder: loads a config saved by the GUI (or creates synthetic/playback sources), records every
+// configured device until the requested duration elapses or SIGINT/SIGTERM is received, and prints periodic throughput stats
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void signal_handler(int signal){
+    stop_requested = 1;
+}
+
+static void print_usage(const char* program){
+    std::cerr << "Usage: " << program << " <config.json> [options]\n"
+              << "       " << program << " (--synthetic <count> | --playback <file.mkv>...) --output <dir> [options]\n"
+              << "  -o, --output <dir>             Save recordings to <dir> (overrides the config's save path)\n"
+              << "  -d, --duration <seconds>       Stop after <seconds> (default: run until interrupted)\n"
+              << "  -s, --stats-interval <seconds> Print throughput stats every <seconds> (default: 5)\n"
+              << "  --format <MKV|Spool>           Recording format (overrides the config's; default: MKV)\n"
+              << "  --compress-depth               Losslessly compress depth/IR in spool recordings\n"
+              << "  --jpeg-quality <1-100>         Encode uncompressed color to MJPEG at this quality before writing\n"
+              << "  --extra-output <dir>           Also spread recordings over <dir> (repeatable; adds to the config's)\n"
+              << "  --placement <name>             Device placement over save paths (Round Robin, Bandwidth Aware)\n"
+              << "  --timelapse-frames <n>         Record one capture per device every <n> frames\n"
+              << "  --timelapse-sec <seconds>      Record one capture per device every <seconds>\n"
+              << "  --imu                          Record each device's IMU (MKV only)\n"
+              << "  --frame-metadata               Write a .frames sidecar of per-capture metadata and timings per device\n"
+              << "  --segment-minutes <minutes>    Start a new file per device every <minutes>\n"
+              << "  --segment-size-mb <MB>         Start a new file when a device's file reaches <MB>\n"
+              << "  --synthetic <count>            Record <count> generated devices instead of real ones\n"
+              << "  --playback <file.mkv>          Replay a recording as a device (repeatable)\n"
+              << "  --color-format <name>          Synthetic color format (MJPG, NV12, YUY2, BGRA32)\n"
+              << "  --color-resolution <name>      Synthetic color resolution (OFF, 720p, ..., 3072p)\n"
+              << "  --depth-mode <name>            Synthetic depth mode (OFF, NFOV, WFOV, ...)\n"
+              << "  --fps <5|15|30>                Synthetic frame rate\n"
+              << "  --metrics-file <file>          Write Prometheus-format metrics snapshots to <file>\n"
+              << "  --metrics-port <port>          Serve metrics on http://127.0.0.1:<port>/metrics\n"
+              << "  --metrics-interval <seconds>   Seconds between metrics snapshots (default: 5)\n"
+              << std::flush;
+}
+
+
+int main(int argc, char* argv[])
+{
+    /***************************************
+     *             ARGUMENTS               *
+     ***************************************/
+
+    if (argc < 2){
+        print_usage(argv[0]);
+        return 1;
+    }
+    std::string config_path;
+    std::string output_path;
+    double duration_sec = 0.0;
+    double stats_interval_sec = 5.0;
+    std::string metrics_file_path;
+    int metrics_port = 0;
+    double metrics_interval_sec = METRICS_DEFAULT_INTERVAL_SEC;
+    int num_synthetic_devices = 0;
+    std::vector<std::string> playback_paths;
+    k4a_device_configuration_t synthetic_config = DEFAULT_CONFIG;
+    RecordingOptions recording_options;
+    std::string recording_format_arg;
+    bool compress_depth_ir = false;
+    int jpeg_quality = 0;
+    std::vector<std::string> extra_output_paths;
+    std::string placement_arg;
+    float segment_minutes = -1.0f;
+    int segment_size_mb = -1;
+    int timelapse_frames = 0;
+    float timelapse_sec = 0.0f;
+    bool imu = false;
+    bool frame_metadata_sidecar = false;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        try {
+            if ((arg == "--synthetic") && has_value){
+                num_synthetic_devices = std::atoi(argv[++i]);
+                continue;
+            } else if ((arg == "--playback") && has_value){
+                playback_paths.push_back(argv[++i]);
+                continue;
+            } else if ((arg == "--color-format") && has_value){
+                synthetic_config.color_format = static_cast<k4a_image_format_t>(parse_name(COLOR_FORMAT_NAMES, argv[++i]));
+                continue;
+            } else if ((arg == "--color-resolution") && has_value){
+                synthetic_config.color_resolution = static_cast<k4a_color_resolution_t>(parse_name(COLOR_RESOLUTION_NAMES, argv[++i]));
+                continue;
+            } else if ((arg == "--depth-mode") && has_value){
+                synthetic_config.depth_mode = static_cast<k4a_depth_mode_t>(parse_name(DEPTH_MODE_NAMES, argv[++i]));
+                continue;
+            } else if ((arg == "--fps") && has_value){
+                synthetic_config.camera_fps = static_cast<k4a_fps_t>(parse_name(FPS_MODE_NAMES, argv[++i]));
+                continue;
+            } else if ((arg == "--format") && has_value){
+                recording_format_arg = argv[++i];
+                parse_name(RECORDING_FORMAT_NAMES, recording_format_arg);
+                continue;
+            } else if ((arg == "--placement") && has_value){
+                placement_arg = argv[++i];
+                parse_name(SAVE_PATH_PLACEMENT_NAMES, placement_arg);
+                continue;
+            }
+        } catch (std::invalid_argument& e){
+            std::cerr << arg << ": " << e.what() << "\n";
+            return 1;
+        }
+        if ((arg == "-o" || arg == "--output") && has_value){
+            output_path = argv[++i];
+        } else if ((arg == "-d" || arg == "--duration") && has_value){
+            duration_sec = std::atof(argv[++i]);
+        } else if ((arg == "-s" || arg == "--stats-interval") && has_value){
+            stats_interval_sec = std::atof(argv[++i]);
+        } else if (arg == "--compress-depth"){
+            compress_depth_ir = true;
+        } else if (arg == "--jpeg-quality" && has_value){
+            jpeg_quality = std::clamp(std::atoi(argv[++i]), 1, 100);
+        } else if (arg == "--extra-output" && has_value){
+            extra_output_paths.push_back(argv[++i]);
+        } else if (arg == "--timelapse-frames" && has_value){
+            timelapse_frames = std::max(std::atoi(argv[++i]), 1);
+        } else if (arg == "--timelapse-sec" && has_value){
+            timelapse_sec = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--imu"){
+            imu = true;
+        } else if (arg == "--frame-metadata"){
+            frame_metadata_sidecar = true;
+        } else if (arg == "--segment-minutes" && has_value){
+            segment_minutes = std::atof(argv[++i]);
+        } else if (arg == "--segment-size-mb" && has_value){
+            segment_size_mb = std::atoi(argv[++i]);
+        } else if (arg == "--metrics-file" && has_value){
+            metrics_file_path = argv[++i];
+        } else if (arg == "--metrics-port" && has_value){
+            metrics_port = std::atoi(argv[++i]);
+        } else if (arg == "--metrics-interval" && has_value){
+            metrics_interval_sec = std::atof(argv[++i]);
+        } else if (arg == "-h" || arg == "--help"){
+            print_usage(argv[0]);
+            return 0;
+        } else if (config_path.empty() && arg[0] != '-'){
+            config_path = arg;
+        } else {
+            std::cerr << "Unrecognized argument '" << arg << "'\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    const bool simulated_sources = num_synthetic_devices > 0 || !playback_paths.empty();
+    if (config_path.empty() == !simulated_sources){
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    /***************************************
+     *         AZURE KINECT SETUP          *
+     ***************************************/
+
+    std::vector<std::unique_ptr<CaptureSource>> devices;
+    std::vector<std::string> available_device_serials;
+    std::vector<std::string> available_device_nicknames;
+    std::vector<k4a_device_configuration_t> configs;
+    bool recording_enabled = false;
+    bool continuous_recording = true;
+    std::string recording_save_path;
+    int num_available_devices = 0;
+    std::shared_ptr<bool[]> available_device_checkboxes;
+
+    if (simulated_sources){
+        // Synthetic and playback sources are created up front; every one of them is recorded
+        try {
+            for (int i = 0; i < num_synthetic_devices; i++){
+                devices.push_back(std::make_unique<SyntheticSource>("SYNTH-" + std::to_string(i)));
+                configs.push_back(synthetic_config);
+            }
+            for (const std::string& playback_path : playback_paths){
+                std::unique_ptr<PlaybackSource> playback = std::make_unique<PlaybackSource>(playback_path);
+                configs.push_back(playback->get_device_configuration());
+                devices.push_back(std::move(playback));
+            }
+        } catch (std::exception& e){
+            print_error_info(e, "Failed to create capture sources");
+            return 1;
+        }
+        num_available_devices = devices.size();
+        available_device_checkboxes = std::shared_ptr<bool[]>(new bool[num_available_devices]);
+        for (int i = 0; i < num_available_devices; i++){
+            available_device_serials.push_back(devices[i]->get_serialnum());
+            available_device_nicknames.emplace_back();
+            available_device_checkboxes[i] = true;
+        }
+    } else {
+        num_available_devices = k4a::device::get_installed_count();
+        available_device_serials = get_available_device_serials(num_available_devices);
+        available_device_nicknames.resize(num_available_devices);
+        available_device_checkboxes = std::shared_ptr<bool[]>(new bool[num_available_devices]);
+
+        bool identical_configs = true;
+        try {
+            load_config_json(config_path, available_device_serials, available_device_nicknames, available_device_checkboxes, &identical_configs, configs, &recording_enabled, &continuous_recording, recording_save_path, &recording_options);
+        } catch (std::exception& e){
+            print_error_info(e, "Failed to load config");
+            return 1;
+        }
+    }
+    if (!output_path.empty()){
+        recording_save_path = output_path;
+    }
+    if (!recording_format_arg.empty()){
+        recording_options.format = static_cast<RecordingFormat>(parse_name(RECORDING_FORMAT_NAMES, recording_format_arg));
+    }
+    if (compress_depth_ir){
+        recording_options.compress_depth_ir = true;
+    }
+    if (jpeg_quality > 0){
+        recording_options.jpeg_encode_color = true;
+        recording_options.jpeg_quality = jpeg_quality;
+    }
+    for (const std::string& path : extra_output_paths){
+        recording_options.extra_save_paths.push_back(path);
+    }
+    if (!placement_arg.empty()){
+        recording_options.placement = static_cast<SavePathPlacement>(parse_name(SAVE_PATH_PLACEMENT_NAMES, placement_arg));
+    }
+    if (segment_minutes >= 0){
+        recording_options.segment_minutes = segment_minutes;
+    }
+    if (segment_size_mb >= 0){
+        recording_options.segment_size_mb = segment_size_mb;
+    }
+    if (timelapse_frames > 0){
+        recording_options.timelapse_mode = TIMELAPSE_MODE_FRAMES;
+        recording_options.timelapse_frames = timelapse_frames;
+    } else if (timelapse_sec > 0){
+        recording_options.timelapse_mode = TIMELAPSE_MODE_SECONDS;
+        recording_options.timelapse_sec = timelapse_sec;
+    }
+    if (imu){
+        recording_options.imu = true;
+    }
+    if (frame_metadata_sidecar){
+        recording_options.frame_metadata = true;
+    }
+    if (recording_save_path.empty()){
+        std::cerr << "[ERROR]: No save path in config; pass one with --output" << std::endl;
+        return 1;
+    }
+    if (!continuous_recording){
+        std::cout << "Note: headless mode always records continuously" << std::endl;
+    }
+
+    std::vector<int> device_idxs;
+    std::vector<std::string> device_nicknames;
+    for (int i = 0; i < num_available_devices; i++){
+        if (available_device_checkboxes[i]){
+            device_idxs.push_back(i);
+            device_nicknames.push_back(available_device_nicknames[i].empty() ? available_device_serials[i] : available_device_nicknames[i]);
+        }
+    }
+    if (device_idxs.empty()){
+        std::cerr << "[ERROR]: None of the " << num_available_devices << " connected device(s) appear in '" << config_path << "'" << std::endl;
+        return 1;
+    }
+
+    /***************************************
+     *              RECORDING              *
+     ***************************************/
+
+    std::vector<std::unique_ptr<RecordingSink>> recordings;
+    std::vector<bool> recording_write_enables;
+    std::vector<std::unique_ptr<FrameMetadataWriter>> frame_metadata;
+    const int num_enabled_devices = device_idxs.size();
+    // Declared before the pool, so they outlive any task still queued when the pool is destroyed
+    std::vector<DeviceMetrics> device_metrics(num_enabled_devices);
+    BS::thread_pool thread_pool(std::max<int>(1, std::min<int>(2 * num_enabled_devices, std::thread::hardware_concurrency() - 1)));
+    std::unique_ptr<MetricsExporter> metrics_exporter;
+    if (!metrics_file_path.empty() || metrics_port > 0){
+        metrics_exporter = std::make_unique<MetricsExporter>(metrics_file_path, metrics_port, metrics_interval_sec);
+    }
+    // Wired-sync rigs also report how many captures group into complete framesets
+    FramesetSynchronizer frameset_sync(configs);
+    std::atomic<bool> capturing = true;
+    std::vector<std::unique_ptr<TimelapseFilter>> timelapses;      // empty unless in time-lapse mode
+    std::vector<std::thread> capture_threads;
+    std::vector<std::unique_ptr<ImuReader>> imu_readers;
+
+    std::signal(SIGINT, signal_handler);
+    std::signal(SIGTERM, signal_handler);
+
+    int return_code = 0;
+    const char* trace_env_path = std::getenv(TRACE_ENV_VAR);
+    if (trace_env_path != nullptr){
+        trace_start();
+    }
+    try {
+        if (!simulated_sources){
+            open_devices(device_idxs, devices);
+        }
+        initialize_recordings(true, true, recording_write_enables, recordings, devices, configs, device_idxs, available_device_serials, available_device_nicknames, recording_save_path, recording_options, nullptr, &frame_metadata);
+        initialize_timelapses(timelapses, configs, recording_options);
+        start_streaming(devices, configs, nullptr, recording_options.imu);
+        for (int i = 0; recording_options.imu && i < num_enabled_devices; i++){
+            imu_readers.push_back(devices[i]->has_imu() ? std::make_unique<ImuReader>(devices[i].get(), recordings[i].get(), device_nicknames[i]) : nullptr);
+        }
+
+        // One blocking capture thread per device; processing and writing happen on the pool
+        for (int i = 0; i < num_enabled_devices; i++){
+            capture_threads.emplace_back([&, i](){
+                trace_set_thread_name("Capture " + std::to_string(i));
+                while (capturing){
+                    std::shared_ptr<k4a::capture> capture = std::make_shared<k4a::capture>();
+                    try {
+                        TraceSpan get_capture_span("get_capture", i);
+                        devices[i]->get_capture(capture.get(), std::chrono::milliseconds(100));
+                    } catch (k4a::error& e){
+                        print_error_info(e, "Failed to get capture from '" + device_nicknames[i] + "'");
+                        stop_requested = 1;
+                        return;
+                    }
+                    if (capture->is_valid()){
+                        FrameTiming timing;
+                        timing.device_index = i;
+                        timing.arrival = std::chrono::steady_clock::now();
+                        timing.device_timestamp = get_capture_device_timestamp(*capture);
+                        timing.sequence = device_metrics[i].record_capture(timing.device_timestamp, std::chrono::microseconds(1000000 / get_fps_value(configs[i].camera_fps)));
+                        // Nothing but recording happens on the pool, so time-lapse skips the rest entirely
+                        if (timelapses.empty() || timelapses[i]->is_due(timing.device_timestamp)){
+                            device_metrics[i].tasks_pending.fetch_add(1, std::memory_order_relaxed);
+                            thread_pool.push_task(process_capture, capture, configs[i], nullptr, nullptr, nullptr, nullptr, false, false, false, false, false, recordings[i].get(), true, timing, &device_metrics[i], frame_metadata[i].get());
+                        }
+                        frameset_sync.push(i, capture, timing);
+                    }
+                }
+            });
+        }
+
+        std::cout << "\nRecording " << num_enabled_devices << " device(s) to '" << recording_save_path << "'; press Ctrl+C to stop" << std::endl;
+        auto start_time = std::chrono::steady_clock::now();
+        auto last_stats_time = start_time;
+        std::vector<uint64_t> last_captures(num_enabled_devices, 0);
+        std::vector<uint64_t> last_bytes(num_enabled_devices, 0);
+        while (!stop_requested){
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            auto now = std::chrono::steady_clock::now();
+            double elapsed_sec = std::chrono::duration<double>(now - start_time).count();
+            if (duration_sec > 0 && elapsed_sec >= duration_sec){
+                break;
+            }
+            for (int i = 0; i < num_enabled_devices; i++){
+                device_metrics[i].bytes_written.store(recordings[i]->get_bytes_written(), std::memory_order_relaxed);
+            }
+
+            double interval_sec = std::chrono::duration<double>(now - last_stats_time).count();
+            if (stats_interval_sec > 0 && interval_sec >= stats_interval_sec){
+                std::cout << std::fixed << std::setprecision(1)
+                          << "[" << elapsed_sec << " s] pool: " << thread_pool.get_tasks_running() << " running, " << thread_pool.get_tasks_queued() << " queued\n";
+                for (int i = 0; i < num_enabled_devices; i++){
+                    uint64_t captures = device_metrics[i].captures;
+                    uint64_t bytes = device_metrics[i].bytes_written;
+                    std::cout << "    " << device_nicknames[i] << ": "
+                              << (captures - last_captures[i]) / interval_sec << " fps, "
+                              << (bytes - last_bytes[i]) / interval_sec / (1024 * 1024) << " MB/s, "
+                              << captures << " captures total, " << device_metrics[i].dropped_frames << " dropped";
+                    if (i < imu_readers.size() && imu_readers[i] != nullptr){
+                        std::cout << ", " << imu_readers[i]->get_num_samples() << " IMU samples (" << imu_readers[i]->get_num_dropped() << " dropped)";
+                    }
+                    std::cout << "\n";
+                    last_captures[i] = captures;
+                    last_bytes[i] = bytes;
+                }
+                if (frameset_sync.is_active()){
+                    std::cout << "    framesets: " << frameset_sync.get_complete_count() << " complete, " << frameset_sync.get_partial_count() << " partial, "
+                              << frameset_sync.get_evicted_count() << " evicted, last spread " << frameset_sync.get_last_spread().count() << " us\n";
+                }
+                std::cout << std::flush;
+                last_stats_time = now;
+            }
+
+            if (metrics_exporter != nullptr && metrics_exporter->snapshot_due()){
+                MetricsSnapshot snapshot;
+                snapshot.time = now;
+                snapshot.streaming = true;
+                snapshot.recording = true;
+                snapshot.pool_tasks_queued = thread_pool.get_tasks_queued();
+                snapshot.pool_tasks_running = thread_pool.get_tasks_running();
+                snapshot.save_path = recording_save_path;
+                for (int i = 0; i < num_enabled_devices; i++){
+                    snapshot.devices.push_back(take_device_metrics_snapshot(available_device_serials[device_idxs[i]], device_metrics[i]));
+                }
+                metrics_exporter->publish(std::move(snapshot));
+            }
+        }
+    } catch (const std::exception& e){
+        print_error_info(e, "Error while recording");
+        return_code = 1;
+    }
+
+    /***************************************
+     *               CLEANUP               *
+     ***************************************/
+
+    std::cout << "\nStopping..." << std::endl;
+    capturing = false;
+    for (std::thread& capture_thread : capture_threads){
+        capture_thread.join();
+    }
+    frameset_sync.flush();
+    // Let queued writes finish before the recordings are closed
+    thread_pool.wait_for_tasks();
+    imu_readers.clear();
+    frame_metadata.clear();
+    stop_streaming(devices, configs, recordings);
+    if (trace_env_path != nullptr){
+        trace_stop(trace_env_path);
+    }
+
+    for (int i = 0; i < num_enabled_devices; i++){
+        std::cout << device_nicknames[i] << ": " << device_metrics[i].captures << " captures recorded, " << device_metrics[i].dropped_frames << " dropped\n";
+    }
+    if (frameset_sync.is_active()){
+        std::cout << "Framesets: " << frameset_sync.get_complete_count() << " complete, " << frameset_sync.get_partial_count() << " partial\n";
+    }
+    std::cout << std::flush;
+
+    return return_code;
+}
@@ -0,0 +1,108 @@
+#include <chrono>
+
+#include "imu.hpp"
+#include "capture.hpp"
+#include "trace.hpp"
+
+ImuReader::ImuReader(CaptureSource* device, RecordingSink* recording, const std::string& name)
+    : m_device(device), m_recording(recording), m_ring(IMU_RING_SIZE)
+{
+    for (std::vector<float>& series : m_plot){
+        series.reserve(IMU_PLOT_POINTS);
+    }
+    m_read_thread = std::thread([this, name]{
+        trace_set_thread_name("IMU Read " + name);
+        read_loop();
+    });
+    m_write_thread = std::thread([this, name]{
+        trace_set_thread_name("IMU Write " + name);
+        write_loop();
+    });
+}
+
+ImuReader::~ImuReader(){
+    m_stop = true;
+    m_read_thread.join();
+    m_write_thread.join();
+    // Samples pushed after the write thread's last pass
+    std::vector<k4a_imu_sample_t> batch;
+    write_batch(batch);
+}
+
+void ImuReader::read_loop(){
+    k4a_imu_sample_t sample;
+    while (!m_stop){
+        try {
+            // Short timeout so a stop is noticed promptly
+            if (!m_device->get_imu_sample(&sample, std::chrono::milliseconds(IMU_WRITE_INTERVAL_MSEC))){
+                continue;
+            }
+        } catch (const k4a::error& e){
+            print_error_info(e, "Failed to read IMU sample");
+            return;
+        }
+        if (!m_ring.try_push(sample)){
+            m_num_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void ImuReader::write_loop(){
+    std::vector<k4a_imu_sample_t> batch;
+    batch.reserve(IMU_RING_SIZE);
+    while (!m_stop){
+        std::this_thread::sleep_for(std::chrono::milliseconds(IMU_WRITE_INTERVAL_MSEC));
+        write_batch(batch);
+    }
+}
+
+void ImuReader::write_batch(std::vector<k4a_imu_sample_t>& batch){
+    batch.clear();
+    while (k4a_imu_sample_t* sample = m_ring.front()){
+        batch.push_back(*sample);
+        m_ring.pop();
+    }
+    if (batch.empty()){
+        return;
+    }
+    m_num_samples.fetch_add(batch.size(), std::memory_order_relaxed);
+
+    if (m_recording != nullptr){
+        TraceSpan write_span("imu_write");
+        try {
+            m_recording->write_imu_samples(batch.data(), batch.size());
+        } catch (const std::exception& e){
+            print_error_info(e, "Failed to write IMU samples");
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_plot_mutex);
+    for (const k4a_imu_sample_t& sample : batch){
+        if (m_plot_counter++ % IMU_PLOT_DECIMATION != 0){
+            continue;
+        }
+        const float values[] = {
+            sample.acc_sample.xyz.x, sample.acc_sample.xyz.y, sample.acc_sample.xyz.z,
+            sample.gyro_sample.xyz.x, sample.gyro_sample.xyz.y, sample.gyro_sample.xyz.z
+        };
+        const bool full = m_plot[0].size() == IMU_PLOT_POINTS;
+        for (size_t s = 0; s < m_plot.size(); s++){
+            if (full){
+                m_plot[s][m_plot_next] = values[s];
+            } else {
+                m_plot[s].push_back(values[s]);
+            }
+        }
+        if (full){
+            m_plot_next = (m_plot_next + 1) % IMU_PLOT_POINTS;
+        }
+    }
+}
+
+void ImuReader::get_plot(std::array<std::vector<float>, IMU_PLOT_SERIES_NAMES.size()>& plot){
+    std::lock_guard<std::mutex> lock(m_plot_mutex);
+    for (size_t s = 0; s < m_plot.size(); s++){
+        plot[s].assign(m_plot[s].begin() + m_plot_next, m_plot[s].end());
+        plot[s].insert(plot[s].end(), m_plot[s].begin(), m_plot[s].begin() + m_plot_next);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include <k4a/k4a.hpp>
+
+#include "SPSCQueue.h"
+#include "capture_source.hpp"
+#include "recording_sink.hpp"
+
+// Samples buffered between the read and write threads (~5 s at 1.6 kHz)
+#define IMU_RING_SIZE 8192
+// Interval at which buffered samples are written and added to the plot
+#define IMU_WRITE_INTERVAL_MSEC 10
+// Every Nth sample is plotted (100 Hz at 1.6 kHz)
+#define IMU_PLOT_DECIMATION 16
+// Points kept per plotted series (5 s at 100 Hz)
+#define IMU_PLOT_POINTS 500
+
+/***********************************************************
+ *                       IMU READER                        *
+ ***********************************************************/
+
+// Plotted series: accelerometer x/y/z (m/s^2), then gyroscope x/y/z (rad/s)
+static const std::array IMU_PLOT_SERIES_NAMES {"Accel X", "Accel Y", "Accel Z", "Gyro X", "Gyro Y", "Gyro Z"};
+
+// Reads one device's IMU on its own thread, which does nothing but pop samples off the device and push them into a
+// lock-free ring, so it keeps up with the 1.6 kHz stream and never contends with the capture loop. A second thread drains
+// the ring every IMU_WRITE_INTERVAL_MSEC, writes the batch to the recording (if any) and keeps a decimated plot history.
+// Samples that arrive while the ring is full are counted and dropped. The IMU must be started before, and stopped after.
+class ImuReader {
+    private:
+        CaptureSource* m_device;
+        RecordingSink* m_recording;
+        rigtorp::SPSCQueue<k4a_imu_sample_t> m_ring;
+        std::atomic<bool> m_stop = false;
+        std::atomic<uint64_t> m_num_samples = 0;
+        std::atomic<uint64_t> m_num_dropped = 0;
+        std::mutex m_plot_mutex;
+        std::array<std::vector<float>, IMU_PLOT_SERIES_NAMES.size()> m_plot;
+        size_t m_plot_next = 0;         // oldest point once the history is full
+        uint64_t m_plot_counter = 0;
+        std::thread m_read_thread;
+        std::thread m_write_thread;
+
+        void read_loop();
+        void write_loop();
+        void write_batch(std::vector<k4a_imu_sample_t>& batch);
+    public:
+        // recording may be nullptr (plot only); it must outlive the reader
+        ImuReader(CaptureSource* device, RecordingSink* recording, const std::string& name);
+        // Writes whatever is still buffered
+        ~ImuReader();
+        ImuReader(const ImuReader&) = delete;
+        ImuReader& operator=(const ImuReader&) = delete;
+
+        // Copies the plot history, oldest point first
+        void get_plot(std::array<std::vector<float>, IMU_PLOT_SERIES_NAMES.size()>& plot);
+        uint64_t get_num_samples() const { return m_num_samples.load(std::memory_order_relaxed); }
+        uint64_t get_num_dropped() const { return m_num_dropped.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <vector>
+#include <cstdio>
+
+#include <turbojpeg.h>
+
+#include "jpeg_encode.hpp"
+#include "trace.hpp"
+
+bool is_uncompressed_color_format(const k4a_image_format_t format){
+    return format == K4A_IMAGE_FORMAT_COLOR_BGRA32 || format == K4A_IMAGE_FORMAT_COLOR_NV12 || format == K4A_IMAGE_FORMAT_COLOR_YUY2;
+}
+
+bool encode_color_to_jpeg(const k4a_image_format_t format, const uint8_t* buffer, const int width, const int height,
+                          const int stride, const int quality, const uint8_t** jpeg, size_t* jpeg_size){
+    // Same per-thread reuse as the decoder; the output buffer is sized for the worst case so turbojpeg never reallocates it
+    thread_local std::unique_ptr<void, int(*)(tjhandle)> jpeg_compressor(tjInitCompress(), tjDestroy);
+    thread_local std::vector<uint8_t> jpeg_buffer;
+    thread_local std::vector<uint8_t> yuv_planes;
+
+    const bool nv12 = format == K4A_IMAGE_FORMAT_COLOR_NV12;
+    const int subsamp = nv12 ? TJSAMP_420 : TJSAMP_422;
+    const size_t max_size = tjBufSize(width, height, subsamp);
+    if (jpeg_buffer.size() < max_size){
+        jpeg_buffer.resize(max_size);
+    }
+    unsigned char* out = jpeg_buffer.data();
+    unsigned long out_size = 0;
+    const int flags = TJFLAG_FASTDCT | TJFLAG_NOREALLOC;
+    int result;
+    if (format == K4A_IMAGE_FORMAT_COLOR_BGRA32){
+        result = tjCompress2(jpeg_compressor.get(), buffer, width, stride, height, TJPF_BGRA, &out, &out_size, subsamp, quality, flags);
+    } else {
+        // turbojpeg takes planar YUV, so the interleaved chroma is split into U and V planes (all K4A widths are even)
+        const int chroma_width = width / 2;
+        const int chroma_height = nv12 ? height / 2 : height;
+        const size_t chroma_size = static_cast<size_t>(chroma_width) * chroma_height;
+        const size_t luma_size = nv12 ? 0 : static_cast<size_t>(width) * height;
+        yuv_planes.resize(luma_size + 2 * chroma_size);
+        uint8_t* y_plane = yuv_planes.data();
+        uint8_t* u_plane = y_plane + luma_size;
+        uint8_t* v_plane = u_plane + chroma_size;
+        const unsigned char* planes[3];
+        int strides[3] = {width, chroma_width, chroma_width};
+        if (nv12){
+            // Y plane as-is, then interleaved UV at half resolution
+            const uint8_t* uv = buffer + static_cast<size_t>(stride) * height;
+            for (int v = 0; v < chroma_height; v++){
+                const uint8_t* row = uv + static_cast<size_t>(v) * stride;
+                for (int u = 0; u < chroma_width; u++){
+                    u_plane[v * chroma_width + u] = row[2 * u];
+                    v_plane[v * chroma_width + u] = row[2 * u + 1];
+                }
+            }
+            planes[0] = buffer;
+            strides[0] = stride;
+        } else {
+            // Y0 U Y1 V per pixel pair
+            for (int v = 0; v < height; v++){
+                const uint8_t* row = buffer + static_cast<size_t>(v) * stride;
+                uint8_t* y_row = y_plane + static_cast<size_t>(v) * width;
+                for (int u = 0; u < chroma_width; u++){
+                    y_row[2 * u] = row[4 * u];
+                    u_plane[v * chroma_width + u] = row[4 * u + 1];
+                    y_row[2 * u + 1] = row[4 * u + 2];
+                    v_plane[v * chroma_width + u] = row[4 * u + 3];
+                }
+            }
+            planes[0] = y_plane;
+        }
+        planes[1] = u_plane;
+        planes[2] = v_plane;
+        result = tjCompressFromYUVPlanes(jpeg_compressor.get(), planes, width, strides, height, subsamp, &out, &out_size, quality, flags);
+    }
+    if (result != 0){
+        std::cerr << "[ERROR] Failed to encode color image\n";
+        fprintf(stderr, "Error code:\t%d\n", result);
+        fprintf(stderr, "Error str:\t%s\n", tjGetErrorStr2(jpeg_compressor.get()));
+        std::cerr << std::flush;
+        return false;
+    }
+    *jpeg = out;
+    *jpeg_size = out_size;
+    return true;
+}
+
+static void release_borrowed_buffer(void* buffer, void* context){}
+
+void JpegEncodeSink::write_capture(const k4a::capture& capture){
+    k4a::image color_img = capture.get_color_image();
+    if (!color_img.is_valid() || !is_uncompressed_color_format(color_img.get_format())){
+        m_sink->write_capture(capture);
+        return;
+    }
+
+    const uint8_t* jpeg = nullptr;
+    size_t jpeg_size = 0;
+    bool success;
+    {
+        TraceSpan encode_span("jpeg_encode");
+        success = encode_color_to_jpeg(color_img.get_format(), color_img.get_buffer(), color_img.get_width_pixels(),
+                                       color_img.get_height_pixels(), color_img.get_stride_bytes(), m_quality, &jpeg, &jpeg_size);
+    }
+
+    // A new capture, so the original (still used for preview) keeps its raw color; depth/IR are shared, not copied
+    k4a::capture encoded = k4a::capture::create();
+    if (success){
+        // The wrapped sink copies the image before returning, so it can borrow this thread's output buffer
+        k4a::image jpeg_img = k4a::image::create_from_buffer(K4A_IMAGE_FORMAT_COLOR_MJPG, color_img.get_width_pixels(),
+            color_img.get_height_pixels(), 0, const_cast<uint8_t*>(jpeg), jpeg_size, release_borrowed_buffer, nullptr);
+        jpeg_img.set_timestamp(color_img.get_device_timestamp());
+        jpeg_img.set_system_timestamp(color_img.get_system_timestamp());
+        jpeg_img.set_exposure_time(color_img.get_exposure());
+        jpeg_img.set_white_balance(color_img.get_white_balance());
+        jpeg_img.set_iso_speed(color_img.get_iso_speed());
+        encoded.set_color_image(jpeg_img);
+    }
+    // On failure the capture is still written, without color, rather than putting raw color in an MJPEG track
+    encoded.set_depth_image(capture.get_depth_image());
+    encoded.set_ir_image(capture.get_ir_image());
+    encoded.set_temperature_c(capture.get_temperature_c());
+    m_sink->write_capture(encoded);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include <k4a/k4a.hpp>
+
+#include "recording_sink.hpp"
+
+/***********************************************************
+ *                  COLOR JPEG ENCODING                    *
+ ***********************************************************/
+
+// Whether a color format is recorded uncompressed (and so can be JPEG-encoded before writing)
+bool is_uncompressed_color_format(const k4a_image_format_t format);
+
+// Compresses a BGRA32, NV12 or YUY2 frame to JPEG (4:2:0 for NV12, 4:2:2 otherwise, matching the source chroma).
+// Each calling thread keeps its own compressor, chroma planes and output buffer; the returned data lives in that
+// buffer and stays valid until the same thread's next call. Returns false (and prints the error) on failure.
+bool encode_color_to_jpeg(const k4a_image_format_t format, const uint8_t* buffer, const int width, const int height,
+                          const int stride, const int quality, const uint8_t** jpeg, size_t* jpeg_size);
+
+// Replaces uncompressed color with MJPEG before passing each capture on, so the wrapped sink (created with an MJPG
+// color_format) records roughly a tenth of the bytes. Encoding runs on the calling pool thread. The encoded image
+// borrows that thread's output buffer, which relies on sinks copying images within write_capture.
+class JpegEncodeSink : public RecordingSink {
+    private:
+        std::unique_ptr<RecordingSink> m_sink;
+        const int m_quality;
+    public:
+        JpegEncodeSink(std::unique_ptr<RecordingSink> sink, const int quality)
+            : m_sink(std::move(sink)), m_quality(quality) {}
+
+        void write_capture(const k4a::capture& capture) override;
+        std::string get_path() override { return m_sink->get_path(); }
+        void trigger() override { m_sink->trigger(); }
+        RecordingSink* get_wrapped_sink() override { return m_sink.get(); }
+        void write_imu_samples(const k4a_imu_sample_t* samples, const size_t count) override { m_sink->write_imu_samples(samples, count); }
+};
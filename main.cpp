@@ -1,7 +1,13 @@
 #include <iostream>
 #include <vector>
+#include <array>
 #include <chrono>
 #include <cstdlib>
+#include <cstdio>
+#include <cfloat>
+#include <ctime>
+#include <filesystem>
+#include <new>
 
 #include <k4a/k4a.hpp>
 #include <k4arecord/record.hpp>
@@ -17,11 +23,50 @@
 #include "imgui_impl_opengl3.h"
 
 #include "utils.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
+#include "frameset_sync.hpp"
+#include "pretrigger.hpp"
+#include "burst.hpp"
+#include "save_paths.hpp"
+#include "jpeg_encode.hpp"
+#include "timelapse.hpp"
+#include "motion.hpp"
+#include "imu.hpp"
+#include "device_watcher.hpp"
+
+#ifdef ENABLE_ALLOCATION_COUNTER
+// Counts heap allocations made by the calling thread; used to check that the steady-state UI frame does not allocate
+static thread_local uint64_t thread_allocation_count = 0;
+void* operator new(std::size_t size){
+    thread_allocation_count++;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)){
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t size) noexcept { std::free(ptr); }
+#endif
 
 int main(int argc, char* argv[])
 {
     int return_code = 0;
 
+    // Tracing from launch when requested via the environment; otherwise it is toggled from the View menu
+    trace_set_thread_name("Render");
+    const char* trace_env_path = std::getenv(TRACE_ENV_VAR);
+    if (trace_env_path != nullptr){
+        trace_start();
+    }
+    // Metrics for unattended use, written to a file and/or served on a local port
+    std::unique_ptr<MetricsExporter> metrics_exporter;
+    const char* metrics_file_env = std::getenv(METRICS_FILE_ENV_VAR);
+    const char* metrics_port_env = std::getenv(METRICS_PORT_ENV_VAR);
+    if (metrics_file_env != nullptr || metrics_port_env != nullptr){
+        metrics_exporter = std::make_unique<MetricsExporter>(metrics_file_env != nullptr ? metrics_file_env : "", metrics_port_env != nullptr ? std::atoi(metrics_port_env) : 0);
+    }
+
     /***************************************
      *          DEAR IMGUI SETUP           *
      ***************************************/
@@ -76,11 +121,19 @@ int main(int argc, char* argv[])
     std::shared_ptr<bool[]> available_device_checkboxes_last;
     std::vector<std::string> available_device_serials;
     std::vector<int> device_idxs;
-    std::vector<k4a::device> devices;
-    std::vector<k4a::record> recordings;
+    std::vector<std::unique_ptr<CaptureSource>> devices;
+    std::vector<std::unique_ptr<RecordingSink>> recordings;
     std::vector<std::string> device_serials;
     std::vector<std::string> device_nicknames;
 
+    // Cached UI labels, rebuilt only when the device set or nicknames change
+    std::vector<std::string> available_device_checkbox_labels;
+    std::vector<std::string> color_window_titles;
+    std::vector<std::string> ir_window_titles;
+    bool device_labels_dirty = true;
+    std::string k4a_log_disp;
+    size_t k4a_log_disp_count = 0;
+
     // Swizzle masks
     GLint bgra_swizzle_mask[] = {GL_BLUE, GL_GREEN, GL_RED, GL_ALPHA};
     GLint red_as_grayscale_swizzle_mask[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
@@ -96,6 +149,9 @@ int main(int argc, char* argv[])
      ***************************************/
     int num_available_devices = 0;
     int last_num_available_devices = 0;
+    // Enumerates devices off the render thread; paused while streaming
+    DeviceWatcher device_watcher;
+    uint64_t device_list_generation = 0;
     int num_enabled_devices = 0;
     bool streaming = false;
     std::shared_ptr<BS::thread_pool> thread_pool;
@@ -106,21 +162,64 @@ int main(int argc, char* argv[])
 
     std::vector<std::unique_ptr<rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>>> color_queues;
     std::vector<std::unique_ptr<rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>>> ir_queues;
+    std::vector<std::unique_ptr<rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>>> color_thumb_queues;
+    std::vector<std::unique_ptr<rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>>> ir_thumb_queues;
     std::vector<std::shared_ptr<Image<uint8_t>>> color_disps;
     std::vector<std::shared_ptr<Image<uint8_t>>> ir_disps;
     std::vector<ImVec2> color_shapes;
     std::vector<ImVec2> ir_shapes;
     std::vector<GLuint> color_textures;
     std::vector<GLuint> ir_textures;
+    ThumbnailAtlas thumbnail_atlas;
 
     bool recording_enabled = false;
     bool continuous_recording = true;
+    RecordingOptions recording_options;
     std::string recording_save_path;
     std::vector<bool> recording_write_enables;
+    // Striping over several save paths: each device's path, and per-path write rates for the Recording panel
+    std::vector<int> save_path_idxs;
+    std::vector<std::unique_ptr<FrameMetadataWriter>> frame_metadata;   // per device while recording (null entries when off)
+    std::vector<std::unique_ptr<TimelapseFilter>> timelapses; // empty unless recording continuously in time-lapse mode
+    std::unique_ptr<MotionTrigger> motion_trigger;            // only when motion-triggered recording is on
+    // Declared after devices and recordings, so the readers stop before either is destroyed
+    std::vector<std::unique_ptr<ImuReader>> imu_readers;      // only while streaming with the IMU on
+    std::array<std::vector<float>, IMU_PLOT_SERIES_NAMES.size()> imu_plot;
+    std::vector<std::string> active_save_paths;
+    std::vector<double> active_save_path_capacities;
+    std::vector<double> save_path_rates;
+    std::vector<uint64_t> save_path_last_bytes;
+    std::chrono::steady_clock::time_point save_path_rate_time;
     std::vector<bool> color_hflips;
     std::vector<bool> ir_hflips;
+    std::vector<bool> color_visibles;
+    std::vector<bool> ir_visibles;
+    std::vector<unsigned int> preview_frame_counters;
+    std::vector<std::unique_ptr<DeviceMetrics>> device_metrics;
+    std::vector<FrameTiming> thumbnail_timings;
+    std::vector<bool> thumbnail_upload_pendings;
+    std::vector<FrameTiming> present_timings;
+    std::vector<bool> present_pendings;
+    std::vector<DeviceStartupTiming> device_startup_timings;
+    std::string streaming_status;   // why the last Start Streaming failed, shown under the button
+    std::vector<int> open_device_idxs; // available-device indices of the devices in `devices`, kept open between sessions
+    bool overview_visible = true;
+    int preview_fps_limit = 0;
+    // Wired-sync framesets; with synchronized preview, member devices are previewed only from complete/partial framesets
+    std::unique_ptr<FramesetSynchronizer> frameset_sync;
+    bool sync_preview = false;
+    Frameset latest_frameset;
+    bool frameset_ready = false;
+    unsigned int frameset_preview_counter = 0;
 
     bool show_debug_window = false;
+#ifdef ENABLE_ALLOCATION_COUNTER
+    // Kept across frames: the Debug window shows the previous UI frame's count
+    uint64_t capture_loop_allocations = 0;
+    uint64_t ui_frame_allocations = 0;
+#endif
+    bool show_overview = false;
+    int focused_device = -1; // device whose full-resolution view is open in overview mode (-1 = none)
 
     try {
         while (!glfwWindowShouldClose(window))
@@ -129,27 +228,99 @@ int main(int argc, char* argv[])
              *  AZURE KINECT   *
              *******************/
 
-            // Only update available devices before streaming
-            if (!streaming){
-                num_available_devices = k4a::device::get_installed_count();
-            }
+#ifdef ENABLE_ALLOCATION_COUNTER
+            uint64_t allocation_count_start = thread_allocation_count;
+#endif
 
             if (streaming){
+                TraceSpan capture_loop_span("capture_loop");
+                // Sinks count what reaches their files; published for the save path rates and /metrics
+                if (recording_enabled && recordings.size() == num_enabled_devices){
+                    for (int i = 0; i < num_enabled_devices; i++){
+                        device_metrics[i]->bytes_written.store(recordings[i]->get_bytes_written(), std::memory_order_relaxed);
+                    }
+                }
+                // Previews are skipped for streams nobody can see; recording is unaffected
+                bool minimized = glfwGetWindowAttrib(window, GLFW_ICONIFIED);
                 for (int i = 0; i < num_enabled_devices; i++){
 
                     // Get capture
                     std::shared_ptr<k4a::capture> capture = std::make_shared<k4a::capture>(k4a::capture());
-                    bool success = devices[i].get_capture(capture.get(), std::chrono::milliseconds(5));
+                    auto get_capture_start = std::chrono::steady_clock::now();
+                    bool success = devices[i]->get_capture(capture.get(), std::chrono::milliseconds(5));
                     if (capture->is_valid()){
-                        thread_pool->push_task(process_capture, capture, configs[i], color_queues[i].get(), ir_queues[i].get(), color_hflips[i], ir_hflips[i], recording_enabled ? &recordings[i] : nullptr, recording_enabled && (continuous_recording || recording_write_enables[i]));
+                        FrameTiming timing;
+                        timing.device_index = i;
+                        timing.arrival = std::chrono::steady_clock::now();
+                        if (trace_enabled()){
+                            trace_record("get_capture", i, get_capture_start, timing.arrival);
+                        }
+                        timing.device_timestamp = get_capture_device_timestamp(*capture);
+                        timing.sequence = device_metrics[i]->record_capture(timing.device_timestamp, std::chrono::microseconds(1000000 / get_fps_value(configs[i].camera_fps)));
+                        // The SDK's system timestamp uses the same monotonic clock; skip it if it does not look like it
+                        std::chrono::steady_clock::time_point host_received(std::chrono::duration_cast<std::chrono::steady_clock::duration>(get_capture_system_timestamp(*capture)));
+                        if (host_received <= timing.arrival && timing.arrival - host_received < std::chrono::seconds(10)){
+                            device_metrics[i]->latency.record(LATENCY_STAGE_SDK_QUEUE, host_received, timing.arrival);
+                        }
+
+                        // Synchronized preview: member previews are dispatched from framesets below
+                        bool synced = sync_preview && frameset_sync->is_active() && frameset_sync->is_member(i);
+                        if (synced){
+                            frameset_sync->push(i, capture, timing);
+                        }
+                        bool preview_due = !synced && !minimized && preview_frame_counters[i]++ % get_preview_decimation(configs[i].camera_fps, preview_fps_limit) == 0;
+                        bool full_res_preview = preview_due && (!show_overview || i == focused_device);
+                        bool color_preview = full_res_preview && color_visibles[i];
+                        bool ir_preview = full_res_preview && ir_visibles[i];
+                        bool thumbnail_preview = preview_due && show_overview && overview_visible;
+                        // With a pre-trigger buffer every capture goes to it, and "Save Capture" writes out the buffered window
+                        bool pretrigger = recording_enabled && !continuous_recording && recording_options.pretrigger;
+                        bool motion_write = false;
+                        if (motion_trigger != nullptr){
+                            TraceSpan motion_span("motion_detect", i);
+                            motion_write = motion_trigger->update(i, *capture);
+                        }
+                        // In burst mode "Save Capture" starts a burst, and every capture goes to it until it is full
+                        BurstSink* burst = recording_enabled && !continuous_recording && !recording_options.pretrigger && recording_options.burst ? find_sink<BurstSink>(recordings[i].get()) : nullptr;
+                        if ((pretrigger || burst != nullptr) && (recording_write_enables[i] || motion_write)){
+                            recordings[i]->trigger();
+                        }
+                        bool burst_write = burst != nullptr && burst->is_capturing();
+                        // In time-lapse mode, captures that are not kept are only previewed
+                        bool continuous_write = continuous_recording && (timelapses.empty() || timelapses[i]->is_due(timing.device_timestamp));
+                        bool recording_write = recording_enabled && (continuous_write || recording_write_enables[i] || pretrigger || motion_write || burst_write);
+                        if (color_preview || ir_preview || thumbnail_preview || recording_write){
+                            device_metrics[i]->tasks_pending.fetch_add(1, std::memory_order_relaxed);
+                            thread_pool->push_task(process_capture, capture, configs[i], color_queues[i].get(), ir_queues[i].get(), color_thumb_queues[i].get(), ir_thumb_queues[i].get(), color_preview, ir_preview, thumbnail_preview, color_hflips[i], ir_hflips[i], recording_enabled ? recordings[i].get() : nullptr, recording_write, timing, device_metrics[i].get(),
+                                i < frame_metadata.size() ? frame_metadata[i].get() : nullptr);
+                        }
                         recording_write_enables[i] = false;
                     }
 
+                    // Thumbnails are staged into the atlas here and uploaded together after the loop
+                    for (auto* thumb_queue : {color_thumb_queues[i].get(), ir_thumb_queues[i].get()}){
+                        while (!thumb_queue->empty()){
+                            Image<uint8_t>& thumb = **(thumb_queue->front());
+                            thumbnail_atlas.write(i, thumb_queue == ir_thumb_queues[i].get(), thumb);
+                            thumbnail_timings[i] = thumb.timing();
+                            thumbnail_timings[i].popped = std::chrono::steady_clock::now();
+                            device_metrics[i]->latency.record(LATENCY_STAGE_DISPLAY_WAIT, thumbnail_timings[i].queued, thumbnail_timings[i].popped);
+                            thumbnail_upload_pendings[i] = true;
+                            thumb_queue->pop();
+                        }
+                    }
+
+                    // Only upload full-resolution textures when a new image has arrived
+                    bool new_color_disp = false;
+                    bool new_ir_disp = false;
                     if (!color_queues[i]->empty()){
                         color_disps[i] = *(color_queues[i]->front());
                         color_queues[i]->pop();
+                        new_color_disp = true;
+                        color_disps[i]->timing().popped = std::chrono::steady_clock::now();
+                        device_metrics[i]->latency.record(LATENCY_STAGE_DISPLAY_WAIT, color_disps[i]->timing().queued, color_disps[i]->timing().popped);
                     }
-                    if (color_disps[i] != nullptr){
+                    if (new_color_disp){
                         unsigned int width = color_disps[i]->width();
                         unsigned int height = color_disps[i]->height();
 
@@ -163,13 +334,24 @@ int main(int argc, char* argv[])
                         glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
                         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, color_disps[i]->get_buffer());
                         color_shapes[i] = ImVec2(width, height);
+
+                        color_disps[i]->timing().uploaded = std::chrono::steady_clock::now();
+                        device_metrics[i]->latency.record(LATENCY_STAGE_UPLOAD, color_disps[i]->timing().popped, color_disps[i]->timing().uploaded);
+                        if (trace_enabled()){
+                            trace_record("upload_color", i, color_disps[i]->timing().popped, color_disps[i]->timing().uploaded);
+                        }
+                        present_timings[i] = color_disps[i]->timing();
+                        present_pendings[i] = true;
                     }
 
                     if (!ir_queues[i]->empty()){
                         ir_disps[i] = *(ir_queues[i]->front());
                         ir_queues[i]->pop();
+                        new_ir_disp = true;
+                        ir_disps[i]->timing().popped = std::chrono::steady_clock::now();
+                        device_metrics[i]->latency.record(LATENCY_STAGE_DISPLAY_WAIT, ir_disps[i]->timing().queued, ir_disps[i]->timing().popped);
                     }
-                    if (ir_disps[i] != nullptr){
+                    if (new_ir_disp){
                         unsigned int width = ir_disps[i]->width();
                         unsigned int height = ir_disps[i]->height();
 
@@ -184,6 +366,51 @@ int main(int argc, char* argv[])
                         glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
                         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, ir_disps[i]->get_buffer());
                         ir_shapes[i] = ImVec2(width, height);
+
+                        ir_disps[i]->timing().uploaded = std::chrono::steady_clock::now();
+                        device_metrics[i]->latency.record(LATENCY_STAGE_UPLOAD, ir_disps[i]->timing().popped, ir_disps[i]->timing().uploaded);
+                        if (trace_enabled()){
+                            trace_record("upload_ir", i, ir_disps[i]->timing().popped, ir_disps[i]->timing().uploaded);
+                        }
+                        present_timings[i] = ir_disps[i]->timing();
+                        present_pendings[i] = true;
+                    }
+                }
+                // Preview the members of the newest frameset together, decimated like the per-device previews
+                if (frameset_ready){
+                    frameset_ready = false;
+                    // Wired-synced devices share a frame rate, so any member's config gives the decimation
+                    int member = 0;
+                    while (!frameset_sync->is_member(member)){
+                        member++;
+                    }
+                    if (!minimized && frameset_preview_counter++ % get_preview_decimation(configs[member].camera_fps, preview_fps_limit) == 0){
+                        for (int i = 0; i < num_enabled_devices; i++){
+                            if (!latest_frameset.captures[i]){
+                                continue;
+                            }
+                            bool full_res_preview = !show_overview || i == focused_device;
+                            bool color_preview = full_res_preview && color_visibles[i];
+                            bool ir_preview = full_res_preview && ir_visibles[i];
+                            bool thumbnail_preview = show_overview && overview_visible;
+                            if (color_preview || ir_preview || thumbnail_preview){
+                                device_metrics[i]->tasks_pending.fetch_add(1, std::memory_order_relaxed);
+                                thread_pool->push_task(process_capture, latest_frameset.captures[i], configs[i], color_queues[i].get(), ir_queues[i].get(), color_thumb_queues[i].get(), ir_thumb_queues[i].get(), color_preview, ir_preview, thumbnail_preview, color_hflips[i], ir_hflips[i], nullptr, false, latest_frameset.timings[i], device_metrics[i].get(), nullptr);
+                            }
+                        }
+                    }
+                }
+                {
+                    TraceSpan upload_span("upload_thumbnails");
+                    thumbnail_atlas.upload();
+                }
+                for (int i = 0; i < num_enabled_devices; i++){
+                    if (thumbnail_upload_pendings[i]){
+                        thumbnail_timings[i].uploaded = std::chrono::steady_clock::now();
+                        device_metrics[i]->latency.record(LATENCY_STAGE_UPLOAD, thumbnail_timings[i].popped, thumbnail_timings[i].uploaded);
+                        present_timings[i] = thumbnail_timings[i];
+                        present_pendings[i] = true;
+                        thumbnail_upload_pendings[i] = false;
                     }
                 }
             }
@@ -192,6 +419,12 @@ int main(int argc, char* argv[])
              *       GUI       *
              *******************/
 
+#ifdef ENABLE_ALLOCATION_COUNTER
+            capture_loop_allocations = thread_allocation_count - allocation_count_start;
+            allocation_count_start = thread_allocation_count;
+#endif
+
+            TraceSpan ui_frame_span("ui_frame");
             glfwPollEvents();
 
             // Start the Dear ImGui frame
@@ -206,23 +439,47 @@ int main(int argc, char* argv[])
             if (ImGui::BeginMainMenuBar()){
                 if (ImGui::BeginMenu("View")){
                     ImGui::MenuItem(show_debug_window ? "Hide Debug Window" : "Show Debug Window", NULL, &show_debug_window);
+                    ImGui::MenuItem(show_overview ? "Hide Overview" : "Show Overview", NULL, &show_overview);
+                    ImGui::Separator();
+                    ImGui::SetNextItemWidth(120);
+                    ImGui::SliderInt("Preview FPS Limit", &preview_fps_limit, 0, 30, preview_fps_limit == 0 ? "Unlimited" : "%d");
+                    ImGui::BeginDisabled(streaming && !frameset_sync->is_active());
+                    ImGui::MenuItem("Synchronized Preview", NULL, &sync_preview);
+                    ImGui::EndDisabled();
+                    ImGui::Separator();
+                    if (ImGui::MenuItem(trace_enabled() ? "Stop Tracing" : "Start Tracing")){
+                        if (!trace_enabled()){
+                            trace_start();
+                        } else {
+                            std::filesystem::path trace_path = trace_env_path != nullptr ? std::filesystem::path(trace_env_path)
+                                : std::filesystem::path(recording_save_path) / ("trace_" + std::to_string(std::time(nullptr)) + ".json");
+                            trace_stop(trace_path.string());
+                        }
+                    }
                     ImGui::EndMenu();
                 }
                 ImGui::EndMainMenuBar();
             }
             bool enabled_devices_changed = false;
-            if (num_available_devices != last_num_available_devices){
+            // Per-device state is in use while streaming, so a device list change is picked up after Stop
+            if (!streaming && device_watcher.get_generation() != device_list_generation){
+                device_list_generation = device_watcher.get_generation();
+                // Devices held open for a warm restart cannot be re-read (indices may have shifted), so close them and enumerate again
+                if (!devices.empty()){
+                    devices.clear();
+                    open_device_idxs.clear();
+                    device_watcher.rescan();
+                }
+                available_device_serials = *device_watcher.get_serials();
+                num_available_devices = available_device_serials.size();
                 std::cout << "# available devices changed from " << last_num_available_devices << " to " << num_available_devices << std::endl;
-                available_device_serials.clear();
                 available_device_nicknames.clear();
                 available_device_checkboxes = std::shared_ptr<bool[]>(new bool[num_available_devices]);
                 available_device_checkboxes_last = std::shared_ptr<bool[]>(new bool[num_available_devices]);
+                available_device_checkbox_labels.clear();
                 for (int i = 0; i < num_available_devices; i++){
-                    k4a::device device = k4a::device::open(i); 
-                    available_device_serials.emplace_back(device.get_serialnum());
-                    device.close();
-
                     available_device_nicknames.emplace_back();
+                    available_device_checkbox_labels.emplace_back(std::to_string(i) + " -");
                     available_device_checkboxes[i] = true;
                     available_device_checkboxes_last[i] = true;
                 }
@@ -256,26 +513,21 @@ int main(int argc, char* argv[])
                         configs.push_back(DEFAULT_CONFIG);
                     }
                 }
+                device_labels_dirty = true;
             }
 
             if (ImGui::CollapsingHeader("Devices", ImGuiTreeNodeFlags_DefaultOpen))
             {
                 ImGui::BeginDisabled(streaming);
                 bool any_devices_selected = false;
-                device_nicknames.clear();
                 for (int i = 0; i < num_available_devices; i++){
                     available_device_checkboxes_last[i] = available_device_checkboxes[i];
-                    ImGui::Checkbox((std::to_string(i) + " -").c_str(), &available_device_checkboxes[i]);
+                    ImGui::Checkbox(available_device_checkbox_labels[i].c_str(), &available_device_checkboxes[i]);
                     ImGui::SameLine();
-                    ImGui::PushID(("available_device_nicknames-" + std::to_string(i)).c_str());
-                    InputTextWithHintString("", available_device_serials[i].c_str(), &available_device_nicknames[i], ImGuiInputTextFlags_CharsNoBlank);
-                    remove_trailing_nulls(available_device_nicknames[i]);
-                    if (available_device_checkboxes[i]){
-                        if (available_device_nicknames[i].empty()){
-                            device_nicknames.push_back(available_device_serials[i]);
-                        } else {
-                            device_nicknames.push_back(available_device_nicknames[i]);
-                        }
+                    ImGui::PushID(i);
+                    if (InputTextWithHintString("", available_device_serials[i].c_str(), &available_device_nicknames[i], ImGuiInputTextFlags_CharsNoBlank)){
+                        remove_trailing_nulls(available_device_nicknames[i]);
+                        device_labels_dirty = true;
                     }
                     ImGui::PopID();
                     any_devices_selected |= available_device_checkboxes[i];
@@ -297,9 +549,11 @@ int main(int argc, char* argv[])
                                 configs,
                                 &recording_enabled,
                                 &continuous_recording,
-                                recording_save_path
+                                recording_save_path,
+                                &recording_options
                             );
                             json_loaded_flag = true;
+                            device_labels_dirty = true;
                         } catch (std::exception& e){
                             print_error_info(e);
                         }
@@ -323,7 +577,8 @@ int main(int argc, char* argv[])
                             available_device_checkboxes,
                             configs,
                             recording_save_path,
-                            continuous_recording
+                            continuous_recording,
+                            recording_options
                         );
                     } else if (result != NFD_CANCEL) {
                         printf("Error: %s\n", NFD::GetError() );
@@ -331,13 +586,18 @@ int main(int argc, char* argv[])
                 }
 
                 if (num_enabled_devices == 0){
-                    ImGui::Text(("Please " + std::string(num_available_devices == 0 ? "connect" : "enable") + " at least one device before proceeding.").c_str());
+                    ImGui::Text("Please %s at least one device before proceeding.", num_available_devices == 0 ? "connect" : "enable");
                 } else {
                     ImGui::Text("");
                 }
                 ImGui::EndDisabled();
             }
 
+            if (device_labels_dirty){
+                update_device_labels(device_idxs, available_device_serials, available_device_nicknames, device_nicknames, color_window_titles, ir_window_titles);
+                device_labels_dirty = false;
+            }
+
             // Streaming & Recording
             // Streaming
             if (num_enabled_devices > 0){
@@ -357,35 +617,37 @@ int main(int argc, char* argv[])
                                     static_assert(std::is_convertible<int, std::underlying_type_t<k4a_depth_mode_t>>::value, "int cannot be converted to k4a_depth_mode_t's resolution underlying type");
                                     static_assert(std::is_convertible<int, std::underlying_type_t<k4a_fps_t>>::value, "int cannot be converted to k4a_fps_t's resolution underlying type");
 
-                                    ImGui::PushID(("Combo_Color_Format-" + device_serials[i]).c_str());
+                                    ImGui::PushID(device_serials[i].c_str());
+                                    ImGui::PushID("Combo_Color_Format");
                                     ImGui::Combo("", reinterpret_cast<int*>(&configs[i].color_format), COLOR_FORMAT_NAMES.data(), COLOR_FORMAT_NAMES.size());
                                     ImGui::SameLine();
                                     ImGui::Text("Color Format");
                                     ImGui::PopID();
 
-                                    ImGui::PushID(("Combo_Color_Resolution-" + device_serials[i]).c_str());
+                                    ImGui::PushID("Combo_Color_Resolution");
                                     ImGui::Combo("", reinterpret_cast<int*>(&configs[i].color_resolution), COLOR_RESOLUTION_NAMES.data(), COLOR_RESOLUTION_NAMES.size());
                                     ImGui::SameLine();
                                     ImGui::Text("Color Resolution");
                                     ImGui::PopID();
 
-                                    ImGui::PushID(("Combo_Depth_Mode-" + device_serials[i]).c_str());
+                                    ImGui::PushID("Combo_Depth_Mode");
                                     ImGui::Combo("", reinterpret_cast<int*>(&configs[i].depth_mode), DEPTH_MODE_NAMES.data(), DEPTH_MODE_NAMES.size());
                                     ImGui::SameLine();
                                     ImGui::Text("Depth Mode");
                                     ImGui::PopID();
 
-                                    ImGui::PushID(("Combo_FPS_Mode-" + device_serials[i]).c_str());
+                                    ImGui::PushID("Combo_FPS_Mode");
                                     ImGui::Combo("", reinterpret_cast<int*>(&configs[i].camera_fps), FPS_MODE_NAMES.data(), FPS_MODE_NAMES.size());
                                     ImGui::SameLine();
                                     ImGui::Text("FPS");
                                     ImGui::PopID();
 
-                                    ImGui::PushID(("Combo_Sync_mode-" + device_serials[i]).c_str());
+                                    ImGui::PushID("Combo_Sync_mode");
                                     ImGui::Combo("", reinterpret_cast<int*>(&configs[i].wired_sync_mode), SYNC_MODE_NAMES.data(), SYNC_MODE_NAMES.size());
                                     ImGui::SameLine();
                                     ImGui::Text("Sync Mode");
                                     ImGui::PopID();
+                                    ImGui::PopID();
 
                                     ImGui::EndTabItem();
                                 } else {
@@ -407,32 +669,122 @@ int main(int argc, char* argv[])
                     if (ImGui::Button(streaming ? "Stop Streaming" : "Start Streaming")){
                         if (!streaming){
                             try {
-                                // First, open devices
-                                open_devices(device_idxs, devices);
-                                num_enabled_devices = devices.size();
-
-                                // Initialize thread variables
-                                initialize_device_thread_vars(num_enabled_devices, thread_pool, color_queues, ir_queues, color_disps, ir_disps, color_shapes, ir_shapes, color_textures, ir_textures, color_hflips, ir_hflips);
+                                device_watcher.pause();
+                                // Devices kept open by the last session are reused, with its pool, queues and textures, if the set is unchanged
+                                if (!devices.empty() && device_idxs == open_device_idxs){
+                                    std::cout << "\nRestarting " << devices.size() << " open device(s)" << std::endl;
+                                    reset_device_session_vars(color_queues, ir_queues, color_thumb_queues, ir_thumb_queues, preview_frame_counters, device_metrics, thumbnail_upload_pendings, present_pendings);
+                                } else {
+                                    // First, open devices
+                                    devices.clear();
+                                    open_device_idxs.clear();
+                                    open_devices(device_idxs, devices, &device_startup_timings);
+                                    open_device_idxs = device_idxs;
+                                    num_enabled_devices = devices.size();
+
+                                    // Initialize thread variables
+                                    initialize_device_thread_vars(num_enabled_devices, thread_pool, color_queues, ir_queues, color_thumb_queues, ir_thumb_queues, color_disps, ir_disps, color_shapes, ir_shapes, color_textures, ir_textures, color_hflips, ir_hflips, color_visibles, ir_visibles, preview_frame_counters, device_metrics, thumbnail_timings, thumbnail_upload_pendings, present_timings, present_pendings);
+
+                                    thumbnail_atlas.resize(num_enabled_devices);
+                                    focused_device = -1;
+                                }
 
                                 // Recordings
-                                initialize_recordings(recording_enabled, recording_write_enables, recordings, devices, configs, device_idxs, available_device_serials, available_device_nicknames, recording_save_path);
+                                initialize_recordings(recording_enabled, continuous_recording, recording_write_enables, recordings, devices, configs, device_idxs, available_device_serials, available_device_nicknames, recording_save_path, recording_options, &save_path_idxs, &frame_metadata);
+                                timelapses.clear();
+                                if (recording_enabled && continuous_recording){
+                                    initialize_timelapses(timelapses, configs, recording_options);
+                                }
+                                motion_trigger.reset();
+                                if (recording_enabled && !continuous_recording && recording_options.motion_trigger){
+                                    motion_trigger = std::make_unique<MotionTrigger>(num_enabled_devices, recording_options);
+                                }
+                                active_save_paths = get_save_paths(recording_save_path, recording_options);
+                                active_save_path_capacities.clear();
+                                if (recording_enabled && active_save_paths.size() > 1 && recording_options.placement == SAVE_PATH_PLACEMENT_BANDWIDTH){
+                                    active_save_path_capacities = measure_save_path_throughputs(active_save_paths); // measured during placement
+                                }
+                                save_path_rates.assign(active_save_paths.size(), 0.0);
+                                save_path_last_bytes.assign(active_save_paths.size(), 0);
+                                save_path_rate_time = std::chrono::steady_clock::now();
+
+                                // Group wired-sync captures into framesets; the consumer runs on this thread from push()
+                                frameset_sync = std::make_unique<FramesetSynchronizer>(configs);
+                                frameset_sync->set_consumer([&](const Frameset& frameset){
+                                    latest_frameset = frameset;
+                                    frameset_ready = true;
+                                });
+                                frameset_ready = false;
+                                frameset_preview_counter = 0;
 
                                 // Start streaming
-                                start_streaming(devices, configs);
+                                start_streaming(devices, configs, &device_startup_timings, recording_options.imu);
+                                imu_readers.clear();
+                                for (int i = 0; recording_options.imu && i < num_enabled_devices; i++){
+                                    // Only continuous recordings get the IMU track, so snapshots don't carry the whole session's samples
+                                    RecordingSink* recording = recording_enabled && continuous_recording ? recordings[i].get() : nullptr;
+                                    imu_readers.push_back(devices[i]->has_imu() ? std::make_unique<ImuReader>(devices[i].get(), recording, device_nicknames[i]) : nullptr);
+                                }
                                 streaming = true;
-                            } catch (k4a::error& e){
+                                streaming_status.clear();
+                            } catch (const std::exception& e){
+                                // Device errors, or buffers (pre-allocated bursts) too large for the available memory
+                                const bool out_of_memory = dynamic_cast<const std::bad_alloc*>(&e) != nullptr;
                                 print_error_info(e, "Error starting streaming");
+                                streaming_status = out_of_memory ? "Not enough memory to start streaming; lower the burst or pre-trigger budget"
+                                                                 : std::string("Error starting streaming: ") + e.what();
+                                imu_readers.clear();
+                                frame_metadata.clear();
                                 stop_streaming(devices, configs, recordings);
+                                open_device_idxs.clear();
                                 streaming = false;
+                                device_watcher.resume();
                             }
                         } else {
-                            stop_streaming(devices, configs, recordings);
+                            // Release buffered captures and let pending writes finish before the recordings close
+                            frameset_sync.reset();
+                            latest_frameset = Frameset();
+                            thread_pool->wait_for_tasks();
+                            imu_readers.clear();
+                            frame_metadata.clear();
+                            // Devices stay open for a warm restart of the same set
+                            stop_streaming(devices, configs, recordings, false);
                             streaming = false;
+                            // Unless the device list changed meanwhile: close them and re-read every index before the watcher
+                            // resumes, so the list it publishes next is not the one scanned while they were held open
+                            if (device_watcher.get_generation() != device_list_generation){
+                                devices.clear();
+                                open_device_idxs.clear();
+                                device_watcher.rescan();
+                            }
+                            device_watcher.resume();
                         }
                     }
                     pop_button_style();
+                    if (!streaming && !streaming_status.empty()){
+                        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", streaming_status.c_str());
+                    }
                     YSpace(10);
                     ImGui::EndDisabled();
+
+                    ImGui::BeginDisabled(streaming);
+                    ImGui::Checkbox("IMU", &recording_options.imu);
+                    ImGui::EndDisabled();
+                    // Decimated accelerometer/gyroscope history per device
+                    for (int i = 0; streaming && i < imu_readers.size(); i++){
+                        if (imu_readers[i] == nullptr || !ImGui::TreeNode(imu_readers[i].get(), "IMU: %s", device_nicknames[i].c_str())){
+                            continue;
+                        }
+                        imu_readers[i]->get_plot(imu_plot);
+                        ImGui::Text("%llu samples, %llu dropped", static_cast<unsigned long long>(imu_readers[i]->get_num_samples()),
+                            static_cast<unsigned long long>(imu_readers[i]->get_num_dropped()));
+                        for (int s = 0; s < imu_plot.size(); s++){
+                            char overlay[32];
+                            snprintf(overlay, sizeof(overlay), "%.3f", imu_plot[s].empty() ? 0.0f : imu_plot[s].back());
+                            ImGui::PlotLines(IMU_PLOT_SERIES_NAMES[s], imu_plot[s].data(), imu_plot[s].size(), 0, overlay, FLT_MAX, FLT_MAX, ImVec2(0, 40));
+                        }
+                        ImGui::TreePop();
+                    }
                 }
 
                 // Recording
@@ -451,14 +803,149 @@ int main(int argc, char* argv[])
                             }
                         }
                     } else {
-                        ImGui::Text(("Saving recordings to '" + recording_save_path + "'").c_str());
+                        ImGui::Text("Saving recordings to '%s'", recording_save_path.c_str());
                         if (ImGui::Button("Cancel")){
                             recording_save_path.clear();
+                            recording_options.extra_save_paths.clear();
                             recording_enabled = false;
                         }
+                        // Further save paths (ideally on other disks) that devices are spread over
+                        for (int p = 0; p < recording_options.extra_save_paths.size(); p++){
+                            ImGui::PushID(p);
+                            ImGui::Text("Also saving to '%s'", recording_options.extra_save_paths[p].c_str());
+                            ImGui::SameLine();
+                            bool remove = ImGui::SmallButton("Remove");
+                            ImGui::PopID();
+                            if (remove){
+                                recording_options.extra_save_paths.erase(recording_options.extra_save_paths.begin() + p);
+                                break;
+                            }
+                        }
+                        if (ImGui::Button("Add Save Path...")){
+                            NFD::UniquePath out_path;
+                            nfdresult_t result = NFD::PickFolder(out_path);
+                            if (result == NFD_OKAY) {
+                                recording_options.extra_save_paths.push_back(out_path.get());
+                            } else if (result != NFD_CANCEL){
+                                printf("Error: %s\n", NFD::GetError() );
+                            }
+                        }
+                        if (!recording_options.extra_save_paths.empty()){
+                            ImGui::SetNextItemWidth(200);
+                            ImGui::Combo("Placement", reinterpret_cast<int*>(&recording_options.placement), SAVE_PATH_PLACEMENT_NAMES.data(), SAVE_PATH_PLACEMENT_NAMES.size());
+                        }
                         ImGui::Checkbox("Continuous Recording", &continuous_recording);
+                        if (continuous_recording){
+                            ImGui::SetNextItemWidth(200);
+                            ImGui::Combo("Time-Lapse", reinterpret_cast<int*>(&recording_options.timelapse_mode), TIMELAPSE_MODE_NAMES.data(), TIMELAPSE_MODE_NAMES.size());
+                            if (recording_options.timelapse_mode == TIMELAPSE_MODE_FRAMES){
+                                ImGui::SetNextItemWidth(200);
+                                ImGui::InputInt("Frames", &recording_options.timelapse_frames, 1, 30);
+                                recording_options.timelapse_frames = std::max(recording_options.timelapse_frames, 1);
+                            } else if (recording_options.timelapse_mode == TIMELAPSE_MODE_SECONDS){
+                                ImGui::SetNextItemWidth(200);
+                                ImGui::InputFloat("Interval (s)", &recording_options.timelapse_sec, 1.0f, 60.0f, "%.1f");
+                                recording_options.timelapse_sec = std::max(recording_options.timelapse_sec, 0.0f);
+                            }
+                        }
+                        ImGui::SetNextItemWidth(200);
+                        ImGui::Combo("Format", reinterpret_cast<int*>(&recording_options.format), RECORDING_FORMAT_NAMES.data(), RECORDING_FORMAT_NAMES.size());
+                        if (recording_options.format == RECORDING_FORMAT_SPOOL){
+                            ImGui::Checkbox("Compress Depth/IR (Lossless)", &recording_options.compress_depth_ir);
+                        }
+                        // Only offered when some device streams uncompressed color (MJPEG is recorded as-is)
+                        if (std::any_of(configs.begin(), configs.end(), [](const k4a_device_configuration_t& config){ return is_uncompressed_color_format(config.color_format); })){
+                            ImGui::Checkbox("Encode Color to MJPEG", &recording_options.jpeg_encode_color);
+                            if (recording_options.jpeg_encode_color){
+                                ImGui::SetNextItemWidth(200);
+                                ImGui::SliderInt("JPEG Quality", &recording_options.jpeg_quality, 50, 100);
+                            }
+                        }
+                        ImGui::Checkbox("Frame Metadata Sidecar", &recording_options.frame_metadata);
+                        // Rolling segments; 0 disables a limit
+                        ImGui::SetNextItemWidth(200);
+                        ImGui::InputFloat("Segment Length (min)", &recording_options.segment_minutes, 1.0f, 10.0f, "%.1f");
+                        recording_options.segment_minutes = std::max(recording_options.segment_minutes, 0.0f);
+                        ImGui::SetNextItemWidth(200);
+                        ImGui::InputInt("Segment Size (MB)", &recording_options.segment_size_mb, 256, 1024);
+                        recording_options.segment_size_mb = std::max(recording_options.segment_size_mb, 0);
+                        if (!continuous_recording){
+                            ImGui::Checkbox("Motion Trigger", &recording_options.motion_trigger);
+                            if (recording_options.motion_trigger){
+                                ImGui::SetNextItemWidth(200);
+                                ImGui::Combo("Motion Source", reinterpret_cast<int*>(&recording_options.motion_source), MOTION_SOURCE_NAMES.data(), MOTION_SOURCE_NAMES.size());
+                                ImGui::SetNextItemWidth(200);
+                                ImGui::SliderFloat("Threshold", &recording_options.motion_threshold_pct, 0.1f, 20.0f, "%.1f%% changed");
+                                ImGui::SetNextItemWidth(200);
+                                ImGui::SliderFloat("Hold", &recording_options.motion_hold_sec, 0.0f, 60.0f, "%.0f s");
+                                ImGui::Checkbox("Trigger All Devices", &recording_options.motion_propagate);
+                            }
+                            ImGui::Checkbox("Pre-Trigger Buffer", &recording_options.pretrigger);
+                            if (recording_options.pretrigger){
+                                ImGui::SetNextItemWidth(200);
+                                ImGui::SliderFloat("Seconds", &recording_options.pretrigger_sec, 1.0f, 60.0f, "%.0f s");
+                                ImGui::SetNextItemWidth(200);
+                                ImGui::InputInt("Budget per Device (MB)", &recording_options.pretrigger_budget_mb, 64, 256);
+                                recording_options.pretrigger_budget_mb = std::max(recording_options.pretrigger_budget_mb, 64);
+                            }
+                            // A pre-trigger buffer already records more than one capture per save
+                            if (!recording_options.pretrigger){
+                                ImGui::Checkbox("Burst", &recording_options.burst);
+                                if (recording_options.burst){
+                                    ImGui::SetNextItemWidth(200);
+                                    ImGui::InputInt("Captures per Burst", &recording_options.burst_captures, 1, 10);
+                                    recording_options.burst_captures = std::clamp(recording_options.burst_captures, 1, 1000);
+                                    // Burst buffers are allocated up front, so the budget caps the captures per burst
+                                    ImGui::SetNextItemWidth(200);
+                                    ImGui::InputInt("Burst Budget per Device (MB)", &recording_options.burst_budget_mb, 64, 256);
+                                    recording_options.burst_budget_mb = std::max(recording_options.burst_budget_mb, 64);
+                                }
+                            }
+                        }
                     }
                     ImGui::EndDisabled();
+                    // Write rate per save path, from the bytes its devices' recordings wrote
+                    if (streaming && recording_enabled && active_save_paths.size() > 1 && save_path_idxs.size() == num_enabled_devices){
+                        auto now = std::chrono::steady_clock::now();
+                        double interval_sec = std::chrono::duration<double>(now - save_path_rate_time).count();
+                        if (interval_sec >= 1.0){
+                            for (int p = 0; p < active_save_paths.size(); p++){
+                                uint64_t bytes = 0;
+                                for (int i = 0; i < num_enabled_devices; i++){
+                                    bytes += save_path_idxs[i] == p ? device_metrics[i]->bytes_written.load(std::memory_order_relaxed) : 0;
+                                }
+                                save_path_rates[p] = bytes >= save_path_last_bytes[p] ? (bytes - save_path_last_bytes[p]) / interval_sec : 0.0;
+                                save_path_last_bytes[p] = bytes;
+                            }
+                            save_path_rate_time = now;
+                        }
+                        for (int p = 0; p < active_save_paths.size(); p++){
+                            if (p < active_save_path_capacities.size()){
+                                ImGui::Text("'%s': %.1f MB/s (measured %.0f MB/s)", active_save_paths[p].c_str(), save_path_rates[p] / (1 << 20), active_save_path_capacities[p] / (1 << 20));
+                            } else {
+                                ImGui::Text("'%s': %.1f MB/s", active_save_paths[p].c_str(), save_path_rates[p] / (1 << 20));
+                            }
+                        }
+                    }
+                    // Live activity per device, against the threshold
+                    for (int i = 0; streaming && motion_trigger != nullptr && i < num_enabled_devices; i++){
+                        ImGui::Text("%s: %.1f%% changed%s", device_nicknames[i].c_str(), 100.0f * motion_trigger->get_activity(i), motion_trigger->is_active(i) ? " (recording)" : "");
+                    }
+                    // Buffered window or burst progress per device
+                    for (int i = 0; streaming && recording_enabled && i < num_enabled_devices; i++){
+                        PretriggerSink* pretrigger = find_sink<PretriggerSink>(recordings[i].get());
+                        if (pretrigger != nullptr){
+                            float window_sec;
+                            size_t bytes, flush_bytes;
+                            pretrigger->get_buffer_stats(&window_sec, &bytes, &flush_bytes);
+                            ImGui::Text("%s: %.1f s buffered (%zu MB), %zu MB writing, %llu dropped", device_nicknames[i].c_str(), window_sec, bytes >> 20, flush_bytes >> 20,
+                                static_cast<unsigned long long>(pretrigger->get_num_dropped()));
+                        }
+                        BurstSink* burst = find_sink<BurstSink>(recordings[i].get());
+                        if (burst != nullptr && burst->is_busy()){
+                            ImGui::Text("%s: burst %u/%u captured%s", device_nicknames[i].c_str(), burst->get_num_filled(), burst->get_num_captures(), burst->is_capturing() ? "" : ", writing");
+                        }
+                    }
                     if (recording_enabled && !continuous_recording && streaming && ImGui::Button("Save Captures")){
                         for (int i = 0; i < num_enabled_devices; i++){
                             recording_write_enables[i] = true;
@@ -474,6 +961,7 @@ int main(int argc, char* argv[])
                 ImGui::EndDisabled();
             }
 
+            std::unique_lock<std::mutex> k4a_log_lock(k4a_log_mutex);
             if (!k4a_log_msgs.empty())
                 ImGui::OpenPopup("Error");
             ImVec2 center = ImGui::GetMainViewport()->GetCenter();
@@ -484,22 +972,28 @@ int main(int argc, char* argv[])
                 ImGui::PushTextWrapPos(ImGui::GetWindowContentRegionWidth());
                 ImGui::Text("The following error(s) occurred:");
                 ImGui::Separator();
-                std::string disp;
-                for (int i = 0; i < k4a_log_msgs.size(); i++){
-                    if (i > 0){
-                        disp.append("\n\n");    
+                if (k4a_log_disp_count != k4a_log_msgs.size()){
+                    k4a_log_disp.clear();
+                    for (int i = 0; i < k4a_log_msgs.size(); i++){
+                        if (i > 0){
+                            k4a_log_disp.append("\n\n");
+                        }
+                        k4a_log_disp.append("[" + std::to_string(i) + "] " + k4a_log_msgs[i]);
                     }
-                    disp.append("[" + std::to_string(i) + "] " + k4a_log_msgs[i]);
+                    k4a_log_disp_count = k4a_log_msgs.size();
                 }
-                ImGui::Text(disp.c_str());
+                ImGui::TextUnformatted(k4a_log_disp.c_str());
                 ImGui::PopTextWrapPos();
                 ImGui::Separator();
                 if (ImGui::Button("Close")){
                     ImGui::CloseCurrentPopup();
                     k4a_log_msgs.clear();
+                    k4a_log_disp.clear();
+                    k4a_log_disp_count = 0;
                 }
                 ImGui::EndPopup();
             }
+            k4a_log_lock.unlock();
 
             ImGui::End();
 
@@ -508,50 +1002,133 @@ int main(int argc, char* argv[])
                 ImGui::SetNextWindowSize(ImVec2(200, 100), ImGuiCond_Appearing);
                 ImGui::Begin("Debug Info");
                 ImGui::PushTextWrapPos(ImGui::GetWindowContentRegionWidth());
-                ImGui::Text(("Running threads: " + std::to_string(streaming ? thread_pool->get_tasks_running() : 0)).c_str());
-                ImGui::Text(("Queued threads: " + std::to_string(streaming ? thread_pool->get_tasks_queued() : 0)).c_str());
+                ImGui::Text("Running threads: %zu", streaming ? thread_pool->get_tasks_running() : 0);
+                ImGui::Text("Queued threads: %zu", streaming ? thread_pool->get_tasks_queued() : 0);
                 ImGui::Text("Average FPS: %.1f", ImGui::GetIO().Framerate);
+                if (streaming && frameset_sync->is_active()){
+                    ImGui::Text("Framesets: %llu complete, %llu partial, %llu evicted", static_cast<unsigned long long>(frameset_sync->get_complete_count()),
+                        static_cast<unsigned long long>(frameset_sync->get_partial_count()), static_cast<unsigned long long>(frameset_sync->get_evicted_count()));
+                    ImGui::Text("Frameset spread: %.3f ms (tolerance %.3f ms)", frameset_sync->get_last_spread().count() / 1000.0, frameset_sync->get_tolerance().count() / 1000.0);
+                }
+                // Per-device stage latencies (ms) since streaming started or the last reset
+                if (streaming && ImGui::Button("Reset Latencies")){
+                    for (std::unique_ptr<DeviceMetrics>& metrics : device_metrics){
+                        metrics->latency.reset();
+                    }
+                }
+                for (int i = 0; streaming && i < num_enabled_devices; i++){
+                    if (ImGui::TreeNode(device_nicknames[i].c_str())){
+                        if (i < device_startup_timings.size()){
+                            ImGui::Text("Open: %.1f ms, start: %.1f ms", device_startup_timings[i].open.count() / 1000.0, device_startup_timings[i].start.count() / 1000.0);
+                        }
+                        if (ImGui::BeginTable("Latencies", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit)){
+                            ImGui::TableSetupColumn("Stage");
+                            ImGui::TableSetupColumn("p50");
+                            ImGui::TableSetupColumn("p95");
+                            ImGui::TableSetupColumn("p99");
+                            ImGui::TableSetupColumn("Count");
+                            ImGui::TableHeadersRow();
+                            for (int stage = 0; stage < NUM_LATENCY_STAGES; stage++){
+                                const LatencyHistogram& histogram = device_metrics[i]->latency.get(static_cast<LatencyStage>(stage));
+                                const std::array<double, 3> percentiles = histogram.percentiles_ms(std::array{50.0, 95.0, 99.0});
+                                ImGui::TableNextRow();
+                                ImGui::TableNextColumn();
+                                ImGui::TextUnformatted(LATENCY_STAGE_NAMES[stage]);
+                                for (double percentile : percentiles){
+                                    ImGui::TableNextColumn();
+                                    ImGui::Text("%.2f", percentile);
+                                }
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%llu", static_cast<unsigned long long>(histogram.count()));
+                            }
+                            ImGui::EndTable();
+                        }
+                        ImGui::TreePop();
+                    }
+                }
+#ifdef ENABLE_ALLOCATION_COUNTER
+                ImGui::Text("Capture loop allocations: %llu", static_cast<unsigned long long>(capture_loop_allocations));
+                ImGui::Text("UI frame allocations: %llu", static_cast<unsigned long long>(ui_frame_allocations));
+#endif
                 ImGui::PopTextWrapPos();
                 ImGui::End();
             }
 
-            // Create window for each camera
+            // Overview: one thumbnail per stream, all sampled from the shared atlas texture
+            if (streaming && show_overview){
+                overview_visible = ImGui::Begin("Overview", &show_overview);
+                const ImVec2 thumb_size(THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+                for (int i = 0; overview_visible && i < num_enabled_devices; i++){
+                    ImGui::PushID(i);
+                    if (i % thumbnail_atlas.devices_per_row() != 0){
+                        ImGui::SameLine();
+                    }
+                    ImGui::BeginGroup();
+                    ImGui::Image(thumbnail_atlas.texture_id(), thumb_size, thumbnail_atlas.uv0(i, 0), thumbnail_atlas.uv1(i, 0));
+                    bool clicked = ImGui::IsItemClicked();
+                    ImGui::SameLine();
+                    ImGui::Image(thumbnail_atlas.texture_id(), thumb_size, thumbnail_atlas.uv0(i, 1), thumbnail_atlas.uv1(i, 1));
+                    clicked |= ImGui::IsItemClicked();
+                    ImGui::TextUnformatted(device_nicknames[i].c_str());
+                    ImGui::EndGroup();
+                    if (clicked){
+                        focused_device = i;
+                    }
+                    ImGui::PopID();
+                }
+                ImGui::End();
+            }
+
+            // Create window for each camera (only the focused device in overview mode)
             if (streaming){
                 ImGui::PushStyleVar(ImGuiStyleVar_WindowMinSize, ImVec2(320, 180));
                 for (int i = 0; i < num_enabled_devices; i++){
+                    if (show_overview && i != focused_device){
+                        continue;
+                    }
                     bool show_save_capture_btn = recording_enabled && !continuous_recording;
+                    bool window_open = true;
+                    bool* p_window_open = show_overview ? &window_open : nullptr;
 
                     if (color_disps[i] != nullptr){
-                        ImGui::Begin((device_nicknames[i] + ": Color").c_str());
-                        ImVec2 disp_area = ImGui::GetWindowContentRegionMax();
-                        disp_area.y -= ImGui::GetFont()->FontSize + 2 * ImGui::GetStyle().FramePadding.y + (show_save_capture_btn ? 2 * ImGui::GetTextLineHeight() : 0) + 2 * ImGui::GetTextLineHeight();
-                        ImGui::Image(reinterpret_cast<void*>(static_cast<intptr_t>(color_textures[i])), get_img_disp_size(color_shapes[i], disp_area));
-
-                        bool color_hflip_temp = color_hflips[i];
-                        ImGui::Checkbox("Flip", &color_hflip_temp);
-                        color_hflips[i] = color_hflip_temp;
-
-                        if (show_save_capture_btn && ImGui::Button("Save Capture")){
-                            recording_write_enables[i] = true;
+                        color_visibles[i] = ImGui::Begin(color_window_titles[i].c_str(), p_window_open);
+                        if (color_visibles[i]){
+                            ImVec2 disp_area = ImGui::GetWindowContentRegionMax();
+                            disp_area.y -= ImGui::GetFont()->FontSize + 2 * ImGui::GetStyle().FramePadding.y + (show_save_capture_btn ? 2 * ImGui::GetTextLineHeight() : 0) + 2 * ImGui::GetTextLineHeight();
+                            ImGui::Image(reinterpret_cast<void*>(static_cast<intptr_t>(color_textures[i])), get_img_disp_size(color_shapes[i], disp_area));
+
+                            bool color_hflip_temp = color_hflips[i];
+                            ImGui::Checkbox("Flip", &color_hflip_temp);
+                            color_hflips[i] = color_hflip_temp;
+
+                            if (show_save_capture_btn && ImGui::Button("Save Capture")){
+                                recording_write_enables[i] = true;
+                            }
                         }
                         ImGui::End();
                     }
 
                     if (ir_disps[i] != nullptr){
-                        ImGui::Begin((device_nicknames[i] + ": IR").c_str());
-                        ImVec2 disp_area = ImGui::GetWindowContentRegionMax();
-                        disp_area.y -= ImGui::GetFont()->FontSize + 2 * ImGui::GetStyle().FramePadding.y + (show_save_capture_btn ? 2 * ImGui::GetTextLineHeight() : 0) + 2 * ImGui::GetTextLineHeight();
-                        ImGui::Image(reinterpret_cast<void*>(static_cast<intptr_t>(ir_textures[i])), get_img_disp_size(ir_shapes[i], disp_area));
-
-                        bool ir_hflip_temp = ir_hflips[i];
-                        ImGui::Checkbox("Flip", &ir_hflip_temp);
-                        ir_hflips[i] = ir_hflip_temp;
-
-                        if (show_save_capture_btn && ImGui::Button("Save Capture")){
-                            recording_write_enables[i] = true;
+                        ir_visibles[i] = ImGui::Begin(ir_window_titles[i].c_str(), p_window_open);
+                        if (ir_visibles[i]){
+                            ImVec2 disp_area = ImGui::GetWindowContentRegionMax();
+                            disp_area.y -= ImGui::GetFont()->FontSize + 2 * ImGui::GetStyle().FramePadding.y + (show_save_capture_btn ? 2 * ImGui::GetTextLineHeight() : 0) + 2 * ImGui::GetTextLineHeight();
+                            ImGui::Image(reinterpret_cast<void*>(static_cast<intptr_t>(ir_textures[i])), get_img_disp_size(ir_shapes[i], disp_area));
+
+                            bool ir_hflip_temp = ir_hflips[i];
+                            ImGui::Checkbox("Flip", &ir_hflip_temp);
+                            ir_hflips[i] = ir_hflip_temp;
+
+                            if (show_save_capture_btn && ImGui::Button("Save Capture")){
+                                recording_write_enables[i] = true;
+                            }
                         }
                         ImGui::End();
                     }
+
+                    if (!window_open){
+                        focused_device = -1;
+                    }
                 }
                 ImGui::PopStyleVar(1);
             }
@@ -573,7 +1150,36 @@ int main(int argc, char* argv[])
                 glfwMakeContextCurrent(backup_current_context);
             }
 
-            glfwSwapBuffers(window);
+            {
+                TraceSpan swap_span("swap_buffers");
+                glfwSwapBuffers(window);
+            }
+            if (streaming){
+                auto presented = std::chrono::steady_clock::now();
+                for (int i = 0; i < num_enabled_devices; i++){
+                    if (present_pendings[i]){
+                        device_metrics[i]->latency.record(LATENCY_STAGE_PRESENT, present_timings[i].uploaded, presented);
+                        device_metrics[i]->latency.record(LATENCY_STAGE_TOTAL, present_timings[i].arrival, presented);
+                        present_pendings[i] = false;
+                    }
+                }
+            }
+#ifdef ENABLE_ALLOCATION_COUNTER
+            ui_frame_allocations = thread_allocation_count - allocation_count_start;
+#endif
+            if (metrics_exporter != nullptr && metrics_exporter->snapshot_due()){
+                MetricsSnapshot snapshot;
+                snapshot.time = std::chrono::steady_clock::now();
+                snapshot.streaming = streaming;
+                snapshot.recording = streaming && recording_enabled;
+                snapshot.pool_tasks_queued = streaming ? thread_pool->get_tasks_queued() : 0;
+                snapshot.pool_tasks_running = streaming ? thread_pool->get_tasks_running() : 0;
+                snapshot.save_path = recording_save_path;
+                for (int i = 0; streaming && i < num_enabled_devices; i++){
+                    snapshot.devices.push_back(take_device_metrics_snapshot(device_serials[i], *device_metrics[i]));
+                }
+                metrics_exporter->publish(std::move(snapshot));
+            }
             last_num_available_devices = num_available_devices;
         }
     } catch (const std::exception& e) {
@@ -586,9 +1192,21 @@ int main(int argc, char* argv[])
      ***************************************/
 
     // Azure Kinect
+    // Closing the window while streaming: let queued processing finish before the metadata writers, metrics
+    // and preview queues it uses are destroyed, since they are declared after the pool
+    if (thread_pool != nullptr){
+        thread_pool->wait_for_tasks();
+    }
+    frame_metadata.clear();
     // devices vector deletes automatically
 
+    // Write out a trace still running at exit
+    if (trace_enabled()){
+        trace_stop(trace_env_path != nullptr ? trace_env_path : "trace.json");
+    }
+
     // Gui
+    thumbnail_atlas.release();
     gui_cleanup(num_enabled_devices, color_textures, window);
 
     std::cout << "Successfully completed cleanup." << std::endl;
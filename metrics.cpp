@@ -0,0 +1,318 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <ctime>
+#include <cstring>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    typedef SOCKET socket_t;
+    #define close_socket closesocket
+    #define SEND_FLAGS 0
+#else
+    #include <sys/socket.h>
+    #include <sys/select.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    #include <unistd.h>
+    typedef int socket_t;
+    #define INVALID_SOCKET (-1)
+    #define close_socket close
+    // A scraper disconnecting mid-response must not raise SIGPIPE and kill the recorder (macOS uses SO_NOSIGPIPE instead)
+    #ifdef MSG_NOSIGNAL
+        #define SEND_FLAGS MSG_NOSIGNAL
+    #else
+        #define SEND_FLAGS 0
+    #endif
+#endif
+
+#include "metrics.hpp"
+
+DeviceMetricsSnapshot take_device_metrics_snapshot(const std::string& serial, const DeviceMetrics& metrics){
+    const LatencyHistogram& decode = metrics.latency.get(LATENCY_STAGE_DECODE);
+    const std::array<double, 2> decode_percentiles = decode.percentiles_ms(std::array{50.0, 99.0});
+    return {
+        serial,
+        metrics.captures.load(std::memory_order_relaxed),
+        metrics.dropped_frames.load(std::memory_order_relaxed),
+        metrics.preview_drops.load(std::memory_order_relaxed),
+        metrics.bytes_written.load(std::memory_order_relaxed),
+        metrics.tasks_pending.load(std::memory_order_relaxed),
+        decode.count(),
+        decode.sum_ms(),
+        decode_percentiles[0],
+        decode_percentiles[1]
+    };
+}
+
+static std::string escape_label_value(const std::string& value){
+    std::string escaped;
+    for (char c : value){
+        if (c == '\\' || c == '"'){
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n'){
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+MetricsExporter::MetricsExporter(const std::string& file_path, const int http_port, const double interval_sec)
+    : m_file_path(file_path), m_http_port(http_port),
+      m_interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval_sec))),
+      m_next_snapshot(std::chrono::steady_clock::now())
+{
+    m_writer_thread = std::thread(&MetricsExporter::writer_loop, this);
+    if (m_http_port > 0){
+        m_http_running = true;
+        m_http_thread = std::thread(&MetricsExporter::http_loop, this);
+    }
+}
+
+MetricsExporter::~MetricsExporter(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_http_running = false;
+    m_writer_thread.join();
+    if (m_http_thread.joinable()){
+        m_http_thread.join();
+    }
+}
+
+bool MetricsExporter::snapshot_due(){
+    auto now = std::chrono::steady_clock::now();
+    if (now < m_next_snapshot){
+        return false;
+    }
+    m_next_snapshot = now + m_interval;
+    return true;
+}
+
+void MetricsExporter::publish(MetricsSnapshot snapshot){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = std::move(snapshot);
+        m_snapshot_pending = true;
+    }
+    m_cv.notify_all();
+}
+
+std::string MetricsExporter::format(const MetricsSnapshot& snapshot){
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "# HELP kinect_metrics_timestamp_seconds Unix time of this snapshot\n"
+        << "# TYPE kinect_metrics_timestamp_seconds gauge\n"
+        << "kinect_metrics_timestamp_seconds " << std::time(nullptr) << "\n"
+        << "# TYPE kinect_streaming gauge\n"
+        << "kinect_streaming " << snapshot.streaming << "\n"
+        << "# TYPE kinect_recording gauge\n"
+        << "kinect_recording " << snapshot.recording << "\n"
+        << "# HELP kinect_pool_tasks_queued Processing tasks waiting for a worker\n"
+        << "# TYPE kinect_pool_tasks_queued gauge\n"
+        << "kinect_pool_tasks_queued " << snapshot.pool_tasks_queued << "\n"
+        << "# TYPE kinect_pool_tasks_running gauge\n"
+        << "kinect_pool_tasks_running " << snapshot.pool_tasks_running << "\n";
+
+    if (!snapshot.save_path.empty()){
+        std::error_code ec;
+        std::filesystem::space_info space = std::filesystem::space(snapshot.save_path, ec);
+        if (!ec){
+            out << "# HELP kinect_disk_free_bytes Space available to the recording save path\n"
+                << "# TYPE kinect_disk_free_bytes gauge\n"
+                << "kinect_disk_free_bytes{path=\"" << escape_label_value(snapshot.save_path) << "\"} " << space.available << "\n";
+        }
+    }
+
+    // Rates are taken against the previous snapshot of the same device
+    double interval_sec = m_has_previous ? std::chrono::duration<double>(snapshot.time - m_previous.time).count() : 0.0;
+    auto find_previous = [&](const std::string& serial) -> const DeviceMetricsSnapshot* {
+        for (const DeviceMetricsSnapshot& device : m_previous.devices){
+            if (device.serial == serial){
+                return &device;
+            }
+        }
+        return nullptr;
+    };
+
+    out << "# HELP kinect_captures_total Captures received from the device\n# TYPE kinect_captures_total counter\n";
+    for (const DeviceMetricsSnapshot& device : snapshot.devices){
+        out << "kinect_captures_total{serial=\"" << escape_label_value(device.serial) << "\"} " << device.captures << "\n";
+    }
+    out << "# HELP kinect_capture_fps Captures per second since the previous snapshot\n# TYPE kinect_capture_fps gauge\n";
+    for (const DeviceMetricsSnapshot& device : snapshot.devices){
+        const DeviceMetricsSnapshot* previous = find_previous(device.serial);
+        double fps = (previous != nullptr && interval_sec > 0 && device.captures >= previous->captures) ? (device.captures - previous->captures) / interval_sec : 0.0;
+        out << "kinect_capture_fps{serial=\"" << escape_label_value(device.serial) << "\"} " << fps << "\n";
+    }
+    out << "# HELP kinect_dropped_frames_total Frames missing from the device timestamp sequence\n# TYPE kinect_dropped_frames_total counter\n";
+    for (const DeviceMetricsSnapshot& device : snapshot.devices){
+        out << "kinect_dropped_frames_total{serial=\"" << escape_label_value(device.serial) << "\"} " << device.dropped_frames << "\n";
+    }
+    out << "# HELP kinect_preview_drops_total Preview images discarded because the display queue was full\n# TYPE kinect_preview_drops_total counter\n";
+    for (const DeviceMetricsSnapshot& device : snapshot.devices){
+        out << "kinect_preview_drops_total{serial=\"" << escape_label_value(device.serial) << "\"} " << device.preview_drops << "\n";
+    }
+    out << "# HELP kinect_tasks_pending Processing tasks queued or running for the device\n# TYPE kinect_tasks_pending gauge\n";
+    for (const DeviceMetricsSnapshot& device : snapshot.devices){
+        out << "kinect_tasks_pending{serial=\"" << escape_label_value(device.serial) << "\"} " << device.tasks_pending << "\n";
+    }
+    out << "# HELP kinect_bytes_written_total Bytes the recording has written to its files\n# TYPE kinect_bytes_written_total counter\n";
+    for (const DeviceMetricsSnapshot& device : snapshot.devices){
+        out << "kinect_bytes_written_total{serial=\"" << escape_label_value(device.serial) << "\"} " << device.bytes_written << "\n";
+    }
+    out << "# HELP kinect_write_bytes_per_second Recording write rate since the previous snapshot\n# TYPE kinect_write_bytes_per_second gauge\n";
+    for (const DeviceMetricsSnapshot& device : snapshot.devices){
+        const DeviceMetricsSnapshot* previous = find_previous(device.serial);
+        double rate = (previous != nullptr && interval_sec > 0 && device.bytes_written >= previous->bytes_written) ? (device.bytes_written - previous->bytes_written) / interval_sec : 0.0;
+        out << "kinect_write_bytes_per_second{serial=\"" << escape_label_value(device.serial) << "\"} " << rate << "\n";
+    }
+    out << "# HELP kinect_decode_ms Preview decode/scale time per image\n# TYPE kinect_decode_ms summary\n";
+    for (const DeviceMetricsSnapshot& device : snapshot.devices){
+        const std::string serial = escape_label_value(device.serial);
+        out << "kinect_decode_ms{serial=\"" << serial << "\",quantile=\"0.5\"} " << device.decode_p50_ms << "\n"
+            << "kinect_decode_ms{serial=\"" << serial << "\",quantile=\"0.99\"} " << device.decode_p99_ms << "\n"
+            << "kinect_decode_ms_sum{serial=\"" << serial << "\"} " << device.decode_sum_ms << "\n"
+            << "kinect_decode_ms_count{serial=\"" << serial << "\"} " << device.decode_count << "\n";
+    }
+    return out.str();
+}
+
+void MetricsExporter::writer_loop(){
+    bool write_failed = false;
+    while (true){
+        MetricsSnapshot snapshot;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this](){ return m_stop || m_snapshot_pending; });
+            if (m_stop){
+                return;
+            }
+            snapshot = std::move(m_pending);
+            m_snapshot_pending = false;
+        }
+
+        std::string text = format(snapshot);
+        m_previous = std::move(snapshot);
+        m_has_previous = true;
+
+        if (!m_file_path.empty()){
+            // Readers never see a partial file: write beside it, then rename over it
+            std::string tmp_path = m_file_path + ".tmp";
+            std::error_code ec;
+            {
+                std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+                out << text;
+                if (!out){
+                    ec = std::make_error_code(std::errc::io_error);
+                }
+            }
+            if (!ec){
+                std::filesystem::rename(tmp_path, m_file_path, ec);
+            }
+            if (ec && !write_failed){
+                std::cerr << "[ERROR] Could not write metrics to '" << m_file_path << "': " << ec.message() << std::endl;
+            }
+            write_failed = static_cast<bool>(ec);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_text = std::move(text);
+    }
+}
+
+void MetricsExporter::http_loop(){
+#ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0){
+        std::cerr << "[ERROR] Metrics endpoint: WSAStartup failed" << std::endl;
+        return;
+    }
+#endif
+    socket_t listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(m_http_port));
+    int reuse = 1;
+    if (listen_socket == INVALID_SOCKET || setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse)) != 0 || bind(listen_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listen_socket, 4) != 0){
+        std::cerr << "[ERROR] Metrics endpoint: could not listen on 127.0.0.1:" << m_http_port << std::endl;
+        if (listen_socket != INVALID_SOCKET){
+            close_socket(listen_socket);
+        }
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return;
+    }
+    std::cout << "Serving metrics on http://127.0.0.1:" << m_http_port << "/metrics" << std::endl;
+
+    while (m_http_running){
+        // Poll so the destructor can stop the loop
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(listen_socket, &read_set);
+        timeval timeout = {0, 200000};
+        if (select(static_cast<int>(listen_socket) + 1, &read_set, nullptr, nullptr, &timeout) <= 0){
+            continue;
+        }
+        socket_t client = accept(listen_socket, nullptr, nullptr);
+        if (client == INVALID_SOCKET){
+            continue;
+        }
+        // A client that connects and then stalls must not hold the only serving thread (or the destructor's join)
+#ifdef _WIN32
+        DWORD client_timeout = METRICS_HTTP_TIMEOUT_MSEC;
+#else
+        timeval client_timeout = {METRICS_HTTP_TIMEOUT_MSEC / 1000, (METRICS_HTTP_TIMEOUT_MSEC % 1000) * 1000};
+#endif
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&client_timeout), sizeof(client_timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&client_timeout), sizeof(client_timeout));
+#ifdef SO_NOSIGPIPE
+        int no_sigpipe = 1;
+        setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+
+        // Only the request line matters; scrapers send small GETs
+        char request[1024];
+        int received = recv(client, request, sizeof(request) - 1, 0);
+        request[received > 0 ? received : 0] = '\0';
+        std::string request_line(request, strcspn(request, "\r\n"));
+        bool found = request_line.rfind("GET /metrics", 0) == 0 || request_line.rfind("GET / ", 0) == 0;
+
+        std::string body;
+        if (found){
+            std::lock_guard<std::mutex> lock(m_mutex);
+            body = m_text;
+        } else {
+            body = "Not found\n";
+        }
+        std::string response = std::string(found ? "HTTP/1.0 200 OK\r\n" : "HTTP/1.0 404 Not Found\r\n")
+            + "Content-Type: text/plain; version=0.0.4\r\n"
+            + "Content-Length: " + std::to_string(body.size()) + "\r\n"
+            + "Connection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.size()){
+            int result = send(client, response.data() + sent, static_cast<int>(response.size() - sent), SEND_FLAGS);
+            if (result <= 0){
+                break;
+            }
+            sent += result;
+        }
+        close_socket(client);
+    }
+    close_socket(listen_socket);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#include "stats.hpp"
+
+// Default interval between metrics snapshots
+#define METRICS_DEFAULT_INTERVAL_SEC 5.0
+// When set, the GUI writes metrics to this file / serves them on this local port
+#define METRICS_FILE_ENV_VAR "KINECT_CONTROLLER_METRICS_FILE"
+#define METRICS_PORT_ENV_VAR "KINECT_CONTROLLER_METRICS_PORT"
+// Longest a metrics client may take to send its request or receive the response before it is dropped
+#define METRICS_HTTP_TIMEOUT_MSEC 1000
+
+/***********************************************************
+ *                         METRICS                         *
+ ***********************************************************/
+
+// Plain copy of a device's counters, taken on the thread that owns the device vectors
+struct DeviceMetricsSnapshot {
+    std::string serial;
+    uint64_t captures;
+    uint64_t dropped_frames;
+    uint64_t preview_drops;
+    uint64_t bytes_written;
+    int64_t tasks_pending;
+    uint64_t decode_count;
+    double decode_sum_ms;
+    double decode_p50_ms;
+    double decode_p99_ms;
+};
+DeviceMetricsSnapshot take_device_metrics_snapshot(const std::string& serial, const DeviceMetrics& metrics);
+
+struct MetricsSnapshot {
+    std::chrono::steady_clock::time_point time;
+    bool streaming;
+    bool recording;
+    size_t pool_tasks_queued;
+    size_t pool_tasks_running;
+    std::string save_path;
+    std::vector<DeviceMetricsSnapshot> devices;
+};
+
+// Formats published snapshots in the Prometheus text format on a background thread, writes them atomically
+// (temporary file + rename, so the file suits node_exporter's textfile collector) and optionally serves them
+// over HTTP on 127.0.0.1. Rates and disk free space are computed on the exporter thread, off the capture path.
+class MetricsExporter {
+    private:
+        std::string m_file_path;
+        int m_http_port;
+        std::chrono::steady_clock::duration m_interval;
+        std::chrono::steady_clock::time_point m_next_snapshot;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_stop = false;
+        bool m_snapshot_pending = false;
+        MetricsSnapshot m_pending;
+        MetricsSnapshot m_previous;
+        bool m_has_previous = false;
+        std::string m_text;
+        std::thread m_writer_thread;
+        std::thread m_http_thread;
+        std::atomic<bool> m_http_running{false};
+
+        void writer_loop();
+        void http_loop();
+        std::string format(const MetricsSnapshot& snapshot);
+    public:
+        // Either output may be disabled (empty path / port 0)
+        MetricsExporter(const std::string& file_path, const int http_port, const double interval_sec = METRICS_DEFAULT_INTERVAL_SEC);
+        ~MetricsExporter();
+        MetricsExporter(const MetricsExporter&) = delete;
+        MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+        // Cheap check for the owner's loop; when true, take a snapshot and publish it
+        bool snapshot_due();
+        void publish(MetricsSnapshot snapshot);
+};
@@ -0,0 +1,127 @@
+#include <cmath>
+#include <algorithm>
+
+#include "motion.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+void MotionDetector::downsample(const uint16_t* pixels, const int width, const int height, const int stride){
+    const size_t row_stride = stride / sizeof(uint16_t);
+#ifdef USE_SSE2
+    static_assert(MOTION_CELL_SIZE == 8, "one SSE2 register holds a cell row");
+    const __m128i ones = _mm_set1_epi16(1);
+#endif
+    for (int cy = 0; cy < m_cells_y; cy++){
+        const uint16_t* block_row = pixels + static_cast<size_t>(cy) * MOTION_CELL_SIZE * row_stride;
+        float* cells = m_cells.data() + static_cast<size_t>(cy) * m_cells_x;
+        for (int cx = 0; cx < m_cells_x; cx++){
+            const uint16_t* block = block_row + cx * MOTION_CELL_SIZE;
+#ifdef USE_SSE2
+            // Pixels are pre-shifted by 4 so the eight-row sums fit the signed 16-bit lanes that _mm_madd_epi16 adds
+            __m128i acc = _mm_setzero_si128();
+            for (int r = 0; r < MOTION_CELL_SIZE; r++){
+                __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + r * row_stride));
+                acc = _mm_add_epi16(acc, _mm_srli_epi16(px, 4));
+            }
+            __m128i sum = _mm_madd_epi16(acc, ones);
+            sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+            sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+            cells[cx] = _mm_cvtsi128_si32(sum) * (16.0f / (MOTION_CELL_SIZE * MOTION_CELL_SIZE));
+#else
+            uint32_t sum = 0;
+            for (int r = 0; r < MOTION_CELL_SIZE; r++){
+                for (int k = 0; k < MOTION_CELL_SIZE; k++){
+                    sum += block[r * row_stride + k];
+                }
+            }
+            cells[cx] = sum * (1.0f / (MOTION_CELL_SIZE * MOTION_CELL_SIZE));
+#endif
+        }
+    }
+}
+
+float MotionDetector::update(const k4a::image& image){
+    const int width = image.get_width_pixels();
+    const int height = image.get_height_pixels();
+    const int cells_x = width / MOTION_CELL_SIZE;
+    const int cells_y = height / MOTION_CELL_SIZE;
+    if (cells_x != m_cells_x || cells_y != m_cells_y){
+        m_cells_x = cells_x;
+        m_cells_y = cells_y;
+        m_cells.assign(static_cast<size_t>(cells_x) * cells_y, 0.0f);
+        m_background.assign(m_cells.size(), 0.0f);
+        m_has_background = false;
+    }
+    if (m_cells.empty()){
+        return 0.0f;
+    }
+    downsample(reinterpret_cast<const uint16_t*>(image.get_buffer()), width, height, image.get_stride_bytes());
+    if (!m_has_background){
+        m_background = m_cells;
+        m_has_background = true;
+        m_activity = 0.0f;
+        return m_activity;
+    }
+
+    // Count active cells and blend the frame into the background in the same pass
+    const size_t num_cells = m_cells.size();
+    float* cells = m_cells.data();
+    float* background = m_background.data();
+    size_t active = 0;
+    size_t i = 0;
+#ifdef USE_SSE2
+    const __m128 relative = _mm_set1_ps(MOTION_CELL_RELATIVE);
+    const __m128 noise_floor = _mm_set1_ps(MOTION_CELL_FLOOR);
+    const __m128 rate = _mm_set1_ps(MOTION_BACKGROUND_RATE);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (; i + 4 <= num_cells; i += 4){
+        __m128 cell = _mm_loadu_ps(cells + i);
+        __m128 bg = _mm_loadu_ps(background + i);
+        __m128 diff = _mm_sub_ps(cell, bg);
+        __m128 limit = _mm_add_ps(_mm_mul_ps(bg, relative), noise_floor);
+        int mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_and_ps(diff, abs_mask), limit));
+        active += (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+        _mm_storeu_ps(background + i, _mm_add_ps(bg, _mm_mul_ps(diff, rate)));
+    }
+#endif
+    for (; i < num_cells; i++){
+        float diff = cells[i] - background[i];
+        active += std::fabs(diff) > background[i] * MOTION_CELL_RELATIVE + MOTION_CELL_FLOOR;
+        background[i] += diff * MOTION_BACKGROUND_RATE;
+    }
+    m_activity = static_cast<float>(active) / num_cells;
+    return m_activity;
+}
+
+/***********************************************************
+ *                     MOTION TRIGGER                      *
+ ***********************************************************/
+
+MotionTrigger::MotionTrigger(const int num_devices, const RecordingOptions& recording_options)
+    : m_detectors(num_devices), m_active_until(num_devices), m_source(recording_options.motion_source),
+      m_threshold(recording_options.motion_threshold_pct / 100.0f), m_propagate(recording_options.motion_propagate),
+      m_hold(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(recording_options.motion_hold_sec))){}
+
+bool MotionTrigger::update(const int device, const k4a::capture& capture){
+    auto now = std::chrono::steady_clock::now();
+    // Passive IR has no depth, and depth-off configurations have neither
+    k4a::image image = m_source == MOTION_SOURCE_DEPTH ? capture.get_depth_image() : capture.get_ir_image();
+    if (!image.is_valid()){
+        image = m_source == MOTION_SOURCE_DEPTH ? capture.get_ir_image() : capture.get_depth_image();
+    }
+    if (image.is_valid() && m_detectors[device].update(image) > m_threshold){
+        if (m_propagate){
+            std::fill(m_active_until.begin(), m_active_until.end(), now + m_hold);
+        } else {
+            m_active_until[device] = now + m_hold;
+        }
+    }
+    return now < m_active_until[device];
+}
+
+bool MotionTrigger::is_active(const int device) const {
+    return std::chrono::steady_clock::now() < m_active_until[device];
+}
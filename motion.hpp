@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include <k4a/k4a.hpp>
+
+#include "recording_sink.hpp"
+
+// Side of the square pixel blocks averaged into one cell before differencing
+#define MOTION_CELL_SIZE 8
+// A cell is active when it differs from the background by more than this fraction of the background, plus a floor
+// that keeps sensor noise in dark (IR) or near (depth) cells from counting
+#define MOTION_CELL_RELATIVE 0.125f
+#define MOTION_CELL_FLOOR 16.0f
+// Weight of each new frame in the running background (about two seconds of memory at 30 fps)
+#define MOTION_BACKGROUND_RATE (1.0f / 64)
+
+/***********************************************************
+ *                    MOTION DETECTION                     *
+ ***********************************************************/
+
+// Cheap per-device activity measure on 16-bit IR or depth frames: the frame is averaged into 8x8-pixel cells (one
+// pass over the image, SSE2 where available), and the fraction of cells that differ from a running background is
+// the activity. A 1024x1024 frame takes a fraction of a millisecond. Not thread-safe; one detector per device.
+class MotionDetector {
+    private:
+        int m_cells_x = 0;
+        int m_cells_y = 0;
+        std::vector<float> m_cells;
+        std::vector<float> m_background;
+        bool m_has_background = false;
+        float m_activity = 0.0f;
+
+        void downsample(const uint16_t* pixels, const int width, const int height, const int stride);
+    public:
+        // Returns the fraction (0-1) of cells that changed, and updates the background; the first frame (or the first
+        // after a size change) only initializes the background
+        float update(const k4a::image& image);
+        float get_activity() const { return m_activity; }
+        void reset(){ m_has_background = false; m_activity = 0.0f; }
+};
+
+// Decides which captures a motion-triggered recording keeps: a device records from the capture whose activity exceeds
+// the threshold until the hold time has passed without any, and with propagation every device records while any does.
+// Called from the capture loop, one capture at a time.
+class MotionTrigger {
+    private:
+        std::vector<MotionDetector> m_detectors;
+        std::vector<std::chrono::steady_clock::time_point> m_active_until;
+        const MotionSource m_source;
+        const float m_threshold;
+        const bool m_propagate;
+        const std::chrono::steady_clock::duration m_hold;
+    public:
+        MotionTrigger(const int num_devices, const RecordingOptions& recording_options);
+
+        // Detects motion in a device's capture; returns whether to record it
+        bool update(const int device, const k4a::capture& capture);
+        bool is_active(const int device) const;
+        float get_activity(const int device) const { return m_detectors[device].get_activity(); }
+};
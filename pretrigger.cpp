@@ -0,0 +1,129 @@
+#include <iterator>
+
+#include "pretrigger.hpp"
+#include "spool.hpp"
+#include "capture.hpp"
+#include "trace.hpp"
+
+PretriggerSink::PretriggerSink(std::unique_ptr<RecordingSink> sink, const float window_sec, const size_t budget_bytes)
+    : m_sink(std::move(sink)), m_window_usec(static_cast<int64_t>(window_sec * 1e6)), m_budget_bytes(budget_bytes)
+{
+    m_flush_thread = std::thread([this]{
+        trace_set_thread_name("Pre-Trigger Flush");
+        flush_loop();
+    });
+}
+
+PretriggerSink::~PretriggerSink(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_flush_thread.join();
+}
+
+void PretriggerSink::write_capture(const k4a::capture& capture){
+    std::vector<uint8_t> buffer;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_spare_buffers.empty()){
+            buffer = std::move(m_spare_buffers.back());
+            m_spare_buffers.pop_back();
+        }
+    }
+
+    // Compression and the copy run on the calling pool thread, outside the lock
+    {
+        TraceSpan encode_span("pretrigger_encode");
+        SpoolCaptureEncoder encoder(capture, true);
+        buffer.resize(encoder.get_size());
+        encoder.write(buffer.data());
+    }
+    Entry entry = {std::move(buffer), get_capture_device_timestamp(capture).count()};
+    const bool triggered = m_trigger_pending.exchange(false);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Pool threads can finish out of order; a capture older than one already written would break the recording's order
+    if (entry.device_timestamp_usec <= m_last_flushed_usec){
+        m_num_dropped.fetch_add(1, std::memory_order_relaxed);
+        m_bytes += entry.data.capacity();
+        recycle(std::move(entry.data));
+        return;
+    }
+    auto it = m_window.end();
+    while (it != m_window.begin() && std::prev(it)->device_timestamp_usec > entry.device_timestamp_usec){
+        it--;
+    }
+    m_bytes += entry.data.capacity();
+    m_window.insert(it, std::move(entry));
+    evict();
+    if (triggered){
+        flush_window();
+    }
+}
+
+void PretriggerSink::recycle(std::vector<uint8_t>&& data){
+    m_bytes -= data.capacity();
+    if (m_spare_buffers.size() < PRETRIGGER_SPARE_BUFFERS){
+        m_spare_buffers.push_back(std::move(data));
+    }
+}
+
+void PretriggerSink::flush_window(){
+    if (m_window.empty()){
+        return;
+    }
+    m_last_flushed_usec = m_window.back().device_timestamp_usec;
+    for (Entry& entry : m_window){
+        m_flush_bytes += entry.data.capacity();
+        m_flush_queue.push_back(std::move(entry));
+    }
+    m_window.clear();
+    m_cv.notify_all();
+}
+
+void PretriggerSink::evict(){
+    while (!m_window.empty()){
+        const bool too_old = m_window.back().device_timestamp_usec - m_window.front().device_timestamp_usec > m_window_usec;
+        if (!too_old && m_bytes <= m_budget_bytes){
+            break;
+        }
+        // Only the budget can empty the window, when pending flushes take up all of it
+        if (m_window.size() == 1){
+            m_num_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        recycle(std::move(m_window.front().data));
+        m_window.pop_front();
+    }
+}
+
+void PretriggerSink::flush_loop(){
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true){
+        m_cv.wait(lock, [this]{ return m_stop || !m_flush_queue.empty(); });
+        if (m_flush_queue.empty()){
+            break;
+        }
+        Entry entry = std::move(m_flush_queue.front());
+        m_flush_queue.pop_front();
+        lock.unlock();
+        try {
+            TraceSpan flush_span("pretrigger_flush");
+            m_sink->write_capture(decode_spool_capture(entry.data.data(), entry.data.size()));
+            m_num_written.fetch_add(1, std::memory_order_relaxed);
+        } catch (const std::exception& e){
+            print_error_info(e, "Failed to write buffered capture to '" + m_sink->get_path() + "'");
+        }
+        lock.lock();
+        m_flush_bytes -= entry.data.capacity();
+        recycle(std::move(entry.data));
+    }
+}
+
+void PretriggerSink::get_buffer_stats(float* window_sec, size_t* bytes, size_t* flush_bytes){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    *window_sec = m_window.empty() ? 0.0f : (m_window.back().device_timestamp_usec - m_window.front().device_timestamp_usec) / 1e6f;
+    *bytes = m_bytes - m_flush_bytes;
+    *flush_bytes = m_flush_bytes;
+}
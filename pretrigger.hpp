@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+#include <k4a/k4a.hpp>
+
+#include "recording_sink.hpp"
+
+// Evicted entry buffers kept for reuse, so a steady-state ring does not allocate
+#define PRETRIGGER_SPARE_BUFFERS 8
+
+/***********************************************************
+ *                   PRE-TRIGGER BUFFER                    *
+ ***********************************************************/
+
+// Keeps the most recent captures of one device in memory (MJPEG as-is, depth/IR RVL-compressed, in the spool
+// capture layout), bounded by a time window and a byte budget. On trigger() the whole window, up to and including
+// the next capture, is handed to a flush thread that decodes and writes it to the wrapped sink in order, so live
+// capture never waits on the disk. Without a trigger, nothing is written.
+class PretriggerSink : public RecordingSink {
+    private:
+        struct Entry {
+            std::vector<uint8_t> data;
+            int64_t device_timestamp_usec;
+        };
+
+        std::unique_ptr<RecordingSink> m_sink;
+        const int64_t m_window_usec;
+        const size_t m_budget_bytes;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::deque<Entry> m_window;             // oldest first
+        std::deque<Entry> m_flush_queue;        // triggered windows waiting to be written
+        std::vector<std::vector<uint8_t>> m_spare_buffers;
+        size_t m_bytes = 0;                     // window + flush queue
+        size_t m_flush_bytes = 0;
+        int64_t m_last_flushed_usec = INT64_MIN;
+        std::atomic<bool> m_trigger_pending = false;
+        std::atomic<uint64_t> m_num_dropped = 0;
+        std::atomic<uint64_t> m_num_written = 0;
+        bool m_stop = false;
+        std::thread m_flush_thread;
+
+        void flush_loop();
+        // Releases an entry's bytes from the budget and keeps its buffer for reuse; called with m_mutex held
+        void recycle(std::vector<uint8_t>&& data);
+        // Moves the window onto the flush queue; called with m_mutex held
+        void flush_window();
+        // Drops the oldest window entries beyond the time window or the budget; called with m_mutex held
+        void evict();
+    public:
+        PretriggerSink(std::unique_ptr<RecordingSink> sink, const float window_sec, const size_t budget_bytes);
+        // Finishes writing triggered windows; an untriggered window is discarded
+        ~PretriggerSink();
+        PretriggerSink(const PretriggerSink&) = delete;
+        PretriggerSink& operator=(const PretriggerSink&) = delete;
+
+        void write_capture(const k4a::capture& capture) override;
+        std::string get_path() override { return m_sink->get_path(); }
+        void trigger() override { m_trigger_pending = true; }
+        RecordingSink* get_wrapped_sink() override { return m_sink.get(); }
+
+        // Buffered span and memory (window and pending flushes), for display
+        void get_buffer_stats(float* window_sec, size_t* bytes, size_t* flush_bytes);
+        // Captures discarded without ever being part of a window: no budget left beside pending flushes, or
+        // arrived (from the pool) after a newer capture had already been flushed
+        uint64_t get_num_dropped() const { return m_num_dropped.load(std::memory_order_relaxed); }
+        uint64_t get_num_written() const { return m_num_written.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include <k4a/k4a.hpp>
+#include <k4arecord/record.hpp>
+
+/***********************************************************
+ *                    RECORDING SINKS                      *
+ ***********************************************************/
+
+enum RecordingFormat {
+    RECORDING_FORMAT_MKV = 0,
+    RECORDING_FORMAT_SPOOL
+};
+static const std::array RECORDING_FORMAT_NAMES {"MKV", "Spool (Raw)"};
+static const std::array RECORDING_FORMAT_EXTENSIONS {".mkv", ".spool"};
+
+// How devices are spread over several save paths
+enum SavePathPlacement {
+    SAVE_PATH_PLACEMENT_ROUND_ROBIN = 0,
+    SAVE_PATH_PLACEMENT_BANDWIDTH
+};
+static const std::array SAVE_PATH_PLACEMENT_NAMES {"Round Robin", "Bandwidth Aware"};
+
+// Continuous recording of every capture, or only of one capture per interval
+enum TimelapseMode {
+    TIMELAPSE_MODE_OFF = 0,
+    TIMELAPSE_MODE_FRAMES,
+    TIMELAPSE_MODE_SECONDS
+};
+static const std::array TIMELAPSE_MODE_NAMES {"Off", "Every N Frames", "Every T Seconds"};
+
+// Image that motion-triggered recording looks for changes in
+enum MotionSource {
+    MOTION_SOURCE_IR = 0,
+    MOTION_SOURCE_DEPTH
+};
+static const std::array MOTION_SOURCE_NAMES {"IR", "Depth"};
+
+// Recording settings beyond the save path, shared by the GUI, headless mode and config files
+struct RecordingOptions {
+    RecordingFormat format = RECORDING_FORMAT_MKV;
+    // Lossless RVL compression of depth/IR (spool only; .mkv keeps the raw 16-bit tracks k4aviewer expects)
+    bool compress_depth_ir = false;
+    // Encode BGRA32/NV12/YUY2 color to MJPEG on the thread pool before writing
+    bool jpeg_encode_color = false;
+    int jpeg_quality = 90;
+    // Non-continuous mode: keep the last pretrigger_sec of captures in memory and write them all on "Save Capture"
+    bool pretrigger = false;
+    float pretrigger_sec = 10.0f;
+    int pretrigger_budget_mb = 1024;   // per device
+    // Non-continuous mode without pre-trigger: "Save Capture" records the next burst_captures captures at full rate,
+    // fewer if that many would not fit in the budget
+    bool burst = false;
+    int burst_captures = 30;
+    int burst_budget_mb = 2048;        // per device
+    // Split recordings into numbered files by duration and/or per-device size (0 = no limit)
+    float segment_minutes = 0.0f;
+    int segment_size_mb = 0;
+    // Further directories (ideally on other disks) that devices' recordings are spread over, besides the save path
+    std::vector<std::string> extra_save_paths;
+    SavePathPlacement placement = SAVE_PATH_PLACEMENT_ROUND_ROBIN;
+    // Continuous mode: record one capture per device every timelapse_frames frames or timelapse_sec seconds
+    TimelapseMode timelapse_mode = TIMELAPSE_MODE_OFF;
+    int timelapse_frames = 30;
+    float timelapse_sec = 10.0f;
+    // Write a .frames sidecar per device with each capture's timestamps, color settings and pipeline stage timings
+    bool frame_metadata = false;
+    // Stream each device's IMU (live plot in the GUI) and record it as the IMU track of .mkv recordings
+    bool imu = false;
+    // Non-continuous mode: record while IR/depth activity (percent of the frame changed) is above the threshold, and
+    // for motion_hold_sec after; with propagation, activity on one device records all of them
+    bool motion_trigger = false;
+    MotionSource motion_source = MOTION_SOURCE_IR;
+    float motion_threshold_pct = 1.0f;
+    float motion_hold_sec = 5.0f;
+    bool motion_propagate = true;
+};
+
+// Anything captures can be recorded to; write_capture may be called from several pool threads at once, and must
+// copy whatever it keeps of the capture before returning
+class RecordingSink {
+    public:
+        virtual ~RecordingSink() = default;
+
+        virtual void write_capture(const k4a::capture& capture) = 0;
+        virtual std::string get_path() = 0;
+        // For sinks that buffer captures in memory (pre-trigger): persist the buffered window with the next capture
+        virtual void trigger(){}
+        // For sinks that transform captures and pass them on to another sink
+        virtual RecordingSink* get_wrapped_sink(){ return nullptr; }
+        // IMU samples in timestamp order, in batches from the device's IMU reader; sinks without an IMU track drop them
+        virtual void write_imu_samples(const k4a_imu_sample_t* samples, const size_t count){}
+        // Bytes put into the recording file(s) so far, as stored (after any encoding); wrapping sinks report their
+        // wrapped sink's, so captures held in memory are not counted until they are written. Callable from any thread.
+        virtual uint64_t get_bytes_written(){
+            RecordingSink* wrapped = get_wrapped_sink();
+            return wrapped != nullptr ? wrapped->get_bytes_written() : 0;
+        }
+};
+
+// First sink of type T in a chain of wrapping sinks, or nullptr
+template<typename T>
+T* find_sink(RecordingSink* sink){
+    while (sink != nullptr){
+        if (T* found = dynamic_cast<T*>(sink)){
+            return found;
+        }
+        sink = sink->get_wrapped_sink();
+    }
+    return nullptr;
+}
+
+// Matroska file written by k4arecord, readable by k4aviewer and the playback API
+class MkvSink : public RecordingSink {
+    private:
+        std::string m_path;
+        std::mutex m_mutex;
+        k4a::record m_record;
+        const bool m_imu;
+        std::atomic<uint64_t> m_bytes_written = 0;
+    public:
+        MkvSink(const std::string& path, const k4a::device& device, const k4a_device_configuration_t& config, const bool imu = false)
+            : m_path(path), m_record(k4a::record::create(path.c_str(), device, config)), m_imu(imu)
+        {
+            if (m_imu){
+                m_record.add_imu_track();
+            }
+            m_record.write_header();
+        }
+
+        // k4a::record destructor will call flush & close automatically
+        void write_capture(const k4a::capture& capture) override {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_record.write_capture(capture);
+            // k4arecord stores the images as they are, so their sizes are what reaches the file (less container overhead)
+            size_t bytes = 0;
+            for (const k4a::image& img : {capture.get_color_image(), capture.get_depth_image(), capture.get_ir_image()}){
+                bytes += img.is_valid() ? img.get_size() : 0;
+            }
+            m_bytes_written.fetch_add(bytes, std::memory_order_relaxed);
+        }
+        std::string get_path() override { return m_path; }
+        void write_imu_samples(const k4a_imu_sample_t* samples, const size_t count) override {
+            if (!m_imu){
+                return;
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (size_t i = 0; i < count; i++){
+                m_record.write_imu_sample(samples[i]);
+            }
+            m_bytes_written.fetch_add(count * sizeof(k4a_imu_sample_t), std::memory_order_relaxed);
+        }
+        uint64_t get_bytes_written() override { return m_bytes_written.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,137 @@
+#include <cstring>
+
+#include "rvl.hpp"
+
+// Nibbles are packed most significant first into 32-bit words, as in the reference implementation
+
+namespace {
+
+class NibbleWriter {
+    private:
+        uint8_t* m_out;
+        uint32_t m_word = 0;
+        int m_nibbles = 0;
+    public:
+        NibbleWriter(uint8_t* out) : m_out(out){}
+
+        inline void write_nibble(const uint32_t nibble){
+            m_word = (m_word << 4) | nibble;
+            if (++m_nibbles == 8){
+                std::memcpy(m_out, &m_word, sizeof(m_word));
+                m_out += sizeof(m_word);
+                m_nibbles = 0;
+                m_word = 0;
+            }
+        }
+        inline void write_vle(uint32_t value){
+            while (value >= 8){
+                write_nibble((value & 7) | 8);
+                value >>= 3;
+            }
+            write_nibble(value);
+        }
+        uint8_t* finish(){
+            if (m_nibbles > 0){
+                m_word <<= 4 * (8 - m_nibbles);
+                std::memcpy(m_out, &m_word, sizeof(m_word));
+                m_out += sizeof(m_word);
+            }
+            return m_out;
+        }
+};
+
+class NibbleReader {
+    private:
+        const uint8_t* m_in;
+        const uint8_t* m_end;
+        uint32_t m_word = 0;
+        int m_nibbles = 0;
+    public:
+        NibbleReader(const uint8_t* in, const size_t size) : m_in(in), m_end(in + size / sizeof(uint32_t) * sizeof(uint32_t)){}
+
+        // Returns false when the input runs out
+        inline bool read_vle(uint32_t* value){
+            uint32_t result = 0;
+            for (int shift = 0; shift < 33; shift += 3){
+                if (m_nibbles == 0){
+                    if (m_in == m_end){
+                        return false;
+                    }
+                    std::memcpy(&m_word, m_in, sizeof(m_word));
+                    m_in += sizeof(m_word);
+                    m_nibbles = 8;
+                }
+                uint32_t nibble = m_word >> 28;
+                m_word <<= 4;
+                m_nibbles--;
+                result |= (nibble & 7) << shift;
+                if ((nibble & 8) == 0){
+                    *value = result;
+                    return true;
+                }
+            }
+            return false;
+        }
+};
+
+}
+
+size_t rvl_max_compressed_size(const size_t num_pixels){
+    // Deltas take at most 6 nibbles per pixel and run lengths at most 3 (every run pair consumes a pixel)
+    return (num_pixels * 9 / 8 + 2) * sizeof(uint32_t);
+}
+
+size_t rvl_compress(const uint16_t* input, const size_t num_pixels, uint8_t* output){
+    NibbleWriter writer(output);
+    const uint16_t* end = input + num_pixels;
+    int32_t previous = 0;
+    while (input != end){
+        const uint16_t* zeros_start = input;
+        while (input != end && *input == 0){
+            input++;
+        }
+        writer.write_vle(static_cast<uint32_t>(input - zeros_start));
+        const uint16_t* nonzeros_start = input;
+        while (input != end && *input != 0){
+            input++;
+        }
+        writer.write_vle(static_cast<uint32_t>(input - nonzeros_start));
+        for (const uint16_t* p = nonzeros_start; p < input; p++){
+            int32_t delta = static_cast<int32_t>(*p) - previous;
+            writer.write_vle((static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31));
+            previous = *p;
+        }
+    }
+    return writer.finish() - output;
+}
+
+bool rvl_decompress(const uint8_t* input, const size_t input_size, uint16_t* output, const size_t num_pixels){
+    NibbleReader reader(input, input_size);
+    uint16_t* out = output;
+    uint16_t* end = output + num_pixels;
+    int32_t previous = 0;
+    while (out != end){
+        uint32_t num_zeros, num_nonzeros;
+        if (!reader.read_vle(&num_zeros) || num_zeros > static_cast<size_t>(end - out)){
+            return false;
+        }
+        std::memset(out, 0, num_zeros * sizeof(uint16_t));
+        out += num_zeros;
+        if (!reader.read_vle(&num_nonzeros) || num_nonzeros > static_cast<size_t>(end - out)){
+            return false;
+        }
+        for (uint32_t i = 0; i < num_nonzeros; i++){
+            uint32_t zigzag;
+            if (!reader.read_vle(&zigzag)){
+                return false;
+            }
+            int32_t delta = static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+            previous += delta;
+            if (previous <= 0 || previous > UINT16_MAX){
+                return false;
+            }
+            *out++ = static_cast<uint16_t>(previous);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/***********************************************************
+ *                   RVL DEPTH COMPRESSION                 *
+ ***********************************************************/
+
+// Lossless run-length + variable-length coding for 16-bit depth/IR (Wilson, "Fast Lossless Depth Image
+// Compression", 2017). Runs of zeros (invalid depth) are run-length coded and the remaining pixels are coded
+// as zigzagged deltas from the previous valid pixel, 3 bits per nibble. A single pass with no tables, so it
+// compresses a 1024x1024 frame in a few milliseconds on one core.
+
+// Upper bound on the compressed size of num_pixels values (the output buffer must be at least this large)
+size_t rvl_max_compressed_size(const size_t num_pixels);
+// Returns the number of bytes written to output (a multiple of 4)
+size_t rvl_compress(const uint16_t* input, const size_t num_pixels, uint8_t* output);
+// Decodes exactly num_pixels values; returns false if input is truncated or malformed
+bool rvl_decompress(const uint8_t* input, const size_t input_size, uint16_t* output, const size_t num_pixels);
@@ -0,0 +1,150 @@
+#include <iostream>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <future>
+#include <chrono>
+#include <filesystem>
+#include <cstdio>
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+#include "save_paths.hpp"
+#include "capture.hpp"
+
+static std::mutex save_path_throughputs_mutex;
+static std::map<std::string, double> save_path_throughputs;
+
+static double measure_save_path_throughput(const std::string& path){
+    std::filesystem::path probe_path = std::filesystem::path(path) / ".write_probe.tmp";
+    FILE* file = fopen(probe_path.string().c_str(), "wb");
+    if (file == nullptr){
+        std::cerr << "[ERROR] Save path '" << path << "' is not writable" << std::endl;
+        return 0.0;
+    }
+    // Incompressible-enough, non-zero data so filesystems cannot skip the writes
+    std::vector<uint8_t> block(SAVE_PATH_PROBE_BLOCK_BYTES);
+    for (size_t i = 0; i < block.size(); i++){
+        block[i] = static_cast<uint8_t>(i * 2654435761u >> 24);
+    }
+    auto start = std::chrono::steady_clock::now();
+    bool success = true;
+    for (size_t written = 0; success && written < SAVE_PATH_PROBE_BYTES; written += block.size()){
+        success = fwrite(block.data(), 1, block.size(), file) == block.size();
+    }
+    // Time until the data is on disk, not in the page cache
+    success = success && fflush(file) == 0;
+#ifdef _WIN32
+    success = success && _commit(_fileno(file)) == 0;
+#else
+    success = success && fsync(fileno(file)) == 0;
+#endif
+    double elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fclose(file);
+    std::error_code error;
+    std::filesystem::remove(probe_path, error);
+    if (!success){
+        std::cerr << "[ERROR] Failed to write to save path '" << path << "'" << std::endl;
+        return 0.0;
+    }
+    return SAVE_PATH_PROBE_BYTES / std::max(elapsed_sec, 1e-6);
+}
+
+std::vector<double> measure_save_path_throughputs(const std::vector<std::string>& paths){
+    std::vector<std::future<double>> measurements;
+    {
+        std::lock_guard<std::mutex> lock(save_path_throughputs_mutex);
+        for (const std::string& path : paths){
+            if (save_path_throughputs.count(path) > 0){
+                measurements.push_back(std::async(std::launch::deferred, [throughput = save_path_throughputs[path]]{ return throughput; }));
+            } else {
+                measurements.push_back(std::async(std::launch::async, measure_save_path_throughput, path));
+            }
+        }
+    }
+    std::vector<double> throughputs;
+    for (int i = 0; i < paths.size(); i++){
+        throughputs.push_back(measurements[i].get());
+        std::lock_guard<std::mutex> lock(save_path_throughputs_mutex);
+        if (throughputs.back() > 0){
+            save_path_throughputs[paths[i]] = throughputs.back();
+        }
+    }
+    return throughputs;
+}
+
+double estimate_recording_bandwidth(const k4a_device_configuration_t& config){
+    double bytes_per_frame = 0.0;
+    if (config.color_resolution != K4A_COLOR_RESOLUTION_OFF){
+        auto [width, height] = get_color_resolution_size(config.color_resolution);
+        double pixels = static_cast<double>(width) * height;
+        switch (config.color_format){
+            case K4A_IMAGE_FORMAT_COLOR_MJPG:   bytes_per_frame += pixels * 4 / SAVE_PATH_MJPEG_RATIO; break;
+            case K4A_IMAGE_FORMAT_COLOR_NV12:   bytes_per_frame += pixels * 3 / 2; break;
+            case K4A_IMAGE_FORMAT_COLOR_YUY2:   bytes_per_frame += pixels * 2; break;
+            default:                            bytes_per_frame += pixels * 4; break;
+        }
+    }
+    if (config.depth_mode != K4A_DEPTH_MODE_OFF){
+        auto [width, height] = get_depth_mode_size(config.depth_mode);
+        // 16-bit IR, plus 16-bit depth except in passive IR mode
+        int num_images = config.depth_mode == K4A_DEPTH_MODE_PASSIVE_IR ? 1 : 2;
+        bytes_per_frame += static_cast<double>(width) * height * 2 * num_images;
+    }
+    return bytes_per_frame * get_fps_value(config.camera_fps);
+}
+
+std::vector<int> place_recordings(
+    const std::vector<std::string>& paths,
+    const std::vector<k4a_device_configuration_t>& configs,
+    const SavePathPlacement placement
+){
+    std::vector<int> path_idxs(configs.size(), 0);
+    if (paths.size() <= 1){
+        return path_idxs;
+    }
+    if (placement == SAVE_PATH_PLACEMENT_ROUND_ROBIN){
+        for (int i = 0; i < configs.size(); i++){
+            path_idxs[i] = i % paths.size();
+        }
+        return path_idxs;
+    }
+
+    std::vector<double> throughputs = measure_save_path_throughputs(paths);
+    std::vector<double> demands;
+    std::vector<int> order;
+    for (int i = 0; i < configs.size(); i++){
+        demands.push_back(estimate_recording_bandwidth(configs[i]));
+        order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](const int a, const int b){ return demands[a] > demands[b]; });
+    std::vector<double> loads(paths.size(), 0.0);
+    for (int i : order){
+        int best_path = -1;
+        double best_utilization = 0.0;
+        for (int p = 0; p < paths.size(); p++){
+            if (throughputs[p] <= 0){
+                continue;
+            }
+            double utilization = (loads[p] + demands[i]) / throughputs[p];
+            if (best_path < 0 || utilization < best_utilization){
+                best_path = p;
+                best_utilization = utilization;
+            }
+        }
+        // No path could be measured: fall back to the save path
+        path_idxs[i] = std::max(best_path, 0);
+        loads[path_idxs[i]] += demands[i];
+    }
+    for (int p = 0; p < paths.size(); p++){
+        if (loads[p] > throughputs[p] && throughputs[p] > 0){
+            std::cerr << "[WARNING] Estimated recording bandwidth to '" << paths[p] << "' (" << loads[p] / (1 << 20) << " MB/s) exceeds its measured throughput ("
+                      << throughputs[p] / (1 << 20) << " MB/s)" << std::endl;
+        }
+    }
+    return path_idxs;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <k4a/k4a.hpp>
+
+#include "recording_sink.hpp"
+
+// Size of the temporary file written to measure a save path's throughput
+#define SAVE_PATH_PROBE_BYTES (64 << 20)
+#define SAVE_PATH_PROBE_BLOCK_BYTES (4 << 20)
+// Assumed MJPEG compression ratio against BGRA when estimating a device's recording bandwidth
+#define SAVE_PATH_MJPEG_RATIO 8.0
+
+/***********************************************************
+ *                    STRIPED SAVE PATHS                   *
+ ***********************************************************/
+
+// Sequential write throughput of a directory in bytes/s, from a temporary file written and synced to disk. Each path
+// is measured once per process (all unmeasured paths concurrently); 0 if the directory is not writable.
+std::vector<double> measure_save_path_throughputs(const std::vector<std::string>& paths);
+// Uncompressed-equivalent recording bandwidth of a device configuration in bytes/s (MJPEG estimated)
+double estimate_recording_bandwidth(const k4a_device_configuration_t& config);
+// Index into paths for each device. Bandwidth-aware placement puts the most demanding devices first, each on the
+// path that leaves the lowest load relative to its measured throughput.
+std::vector<int> place_recordings(
+    const std::vector<std::string>& paths,
+    const std::vector<k4a_device_configuration_t>& configs,
+    const SavePathPlacement placement
+);
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <filesystem>
+
+#include "segment.hpp"
+#include "capture.hpp"
+#include "capture_source.hpp"
+#include "trace.hpp"
+
+/***********************************************************
+ *                    SEGMENT SCHEDULE                     *
+ ***********************************************************/
+
+SegmentSchedule::SegmentSchedule(const float duration_sec, const int64_t frame_period_usec)
+    : m_duration_usec(static_cast<int64_t>(duration_sec * 1e6)), m_frame_period_usec(frame_period_usec){}
+
+uint32_t SegmentSchedule::get_segment(const int64_t timestamp_usec){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_started){
+        m_started = true;
+        m_segment_start_usec = timestamp_usec;
+        m_latest_usec = timestamp_usec;
+    }
+    m_latest_usec = std::max(m_latest_usec, timestamp_usec);
+    if (m_duration_usec > 0){
+        while (timestamp_usec >= m_segment_start_usec + m_duration_usec){
+            m_segment_start_usec += m_duration_usec;
+            m_boundaries.push_back(m_segment_start_usec);
+        }
+    }
+    return static_cast<uint32_t>(std::upper_bound(m_boundaries.begin(), m_boundaries.end(), timestamp_usec) - m_boundaries.begin());
+}
+
+void SegmentSchedule::request_split(const uint32_t segment){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Another device may already have split this segment
+    if (segment != m_boundaries.size()){
+        return;
+    }
+    m_segment_start_usec = m_latest_usec + m_frame_period_usec / 2;
+    m_boundaries.push_back(m_segment_start_usec);
+}
+
+/***********************************************************
+ *                     SEGMENTED SINK                      *
+ ***********************************************************/
+
+SegmentedSink::SegmentedSink(SinkFactory factory, std::shared_ptr<SegmentSchedule> schedule, const int64_t timestamp_offset_usec, const uint64_t size_limit_bytes)
+    : m_factory(std::move(factory)), m_schedule(std::move(schedule)), m_timestamp_offset_usec(timestamp_offset_usec), m_size_limit_bytes(size_limit_bytes)
+{
+    m_current = m_factory(0);
+    m_thread = std::thread([this]{
+        trace_set_thread_name("Segment Opener");
+        background_loop();
+    });
+}
+
+SegmentedSink::~SegmentedSink(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+    m_current.reset();
+    // The pre-created segment holds only a header
+    if (m_next != nullptr){
+        std::string path = m_next->get_path();
+        m_next.reset();
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+}
+
+void SegmentedSink::background_loop(){
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true){
+        m_cv.wait(lock, [this]{ return m_stop || !m_retired.empty() || (m_next == nullptr && !m_next_failed); });
+        if (!m_retired.empty()){
+            auto [retired, counted_bytes] = std::move(m_retired.front());
+            m_retired.pop_front();
+            lock.unlock();
+            // Pool threads that picked up the old segment just before the switch finish their writes first
+            while (retired.use_count() > 1){
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            // Those late writes were not counted at the switch
+            const uint64_t late_bytes = retired->get_bytes_written() - counted_bytes;
+            {
+                TraceSpan close_span("segment_close");
+                retired.reset();
+            }
+            lock.lock();
+            m_retired_bytes += late_bytes;
+            continue;
+        }
+        if (m_stop){
+            break;
+        }
+
+        const uint32_t segment = m_current_segment + 1;
+        lock.unlock();
+        std::unique_ptr<RecordingSink> next;
+        try {
+            TraceSpan open_span("segment_open");
+            next = m_factory(segment);
+        } catch (const std::exception& e){
+            print_error_info(e, "Failed to create recording segment " + std::to_string(segment));
+        }
+        lock.lock();
+        // A segment skipped meanwhile (no captures for a whole segment) leaves this one unused
+        if (next != nullptr && segment == m_current_segment + 1){
+            m_next = std::move(next);
+        } else if (next == nullptr){
+            m_next_failed = true;
+        }
+        m_cv.notify_all();
+    }
+}
+
+void SegmentedSink::write_capture(const k4a::capture& capture){
+    const uint32_t segment = m_schedule->get_segment(get_capture_device_timestamp(capture).count() - m_timestamp_offset_usec);
+
+    std::shared_ptr<RecordingSink> sink;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        // Captures finishing out of order just after a switch stay in the newer segment
+        if (segment > m_current_segment){
+            std::unique_ptr<RecordingSink> next;
+            if (segment == m_current_segment + 1){
+                // Normally ready long before; waits only if opening takes longer than a whole segment
+                m_cv.wait(lock, [this]{ return m_next != nullptr || m_next_failed; });
+                next = std::move(m_next);
+            } else if (m_next != nullptr){
+                // No captures for a whole segment: it stays an empty file, keeping numbering aligned across devices
+                const uint64_t bytes = m_next->get_bytes_written();
+                m_retired_bytes += bytes;
+                m_retired.emplace_back(std::move(m_next), bytes);
+            }
+            if (next == nullptr){
+                try {
+                    next = m_factory(segment);
+                } catch (const std::exception& e){
+                    print_error_info(e, "Failed to create recording segment " + std::to_string(segment) + "; continuing in the current one");
+                }
+            }
+            if (next != nullptr){
+                const uint64_t bytes = m_current->get_bytes_written();
+                m_retired_bytes += bytes;
+                m_retired.emplace_back(std::move(m_current), bytes);
+                m_current = std::move(next);
+                m_split_requested = false;
+            }
+            m_current_segment = segment;
+            m_next_failed = false;
+            m_cv.notify_all();
+        }
+        sink = m_current;
+    }
+    sink->write_capture(capture);
+
+    // Limit on what the segment wrote (after any compression), not the raw image sizes
+    if (m_size_limit_bytes > 0 && sink->get_bytes_written() >= m_size_limit_bytes){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (sink == m_current && !m_split_requested){
+            m_split_requested = true;
+            m_schedule->request_split(m_current_segment);
+        }
+    }
+}
+
+std::string SegmentedSink::get_path(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_current->get_path();
+}
+
+uint64_t SegmentedSink::get_bytes_written(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_retired_bytes + m_current->get_bytes_written();
+}
+
+void SegmentedSink::write_imu_samples(const k4a_imu_sample_t* samples, const size_t count){
+    std::shared_ptr<RecordingSink> sink;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        sink = m_current;
+    }
+    sink->write_imu_samples(samples, count);
+}
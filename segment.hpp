@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+#include <k4a/k4a.hpp>
+
+#include "recording_sink.hpp"
+
+/***********************************************************
+ *                  SEGMENTED RECORDINGS                   *
+ ***********************************************************/
+
+// Decides where recordings are split, in device time. Every device sharing a schedule splits before the first capture
+// at or after each boundary, so wired-sync devices (with subordinate delays removed) switch on the same frame.
+// Boundaries come every duration after the previous one and, when a device's segment reaches the size limit,
+// half a frame period past the latest capture seen from any device.
+class SegmentSchedule {
+    private:
+        std::mutex m_mutex;
+        const int64_t m_duration_usec;          // 0 = no duration limit
+        const int64_t m_frame_period_usec;
+        bool m_started = false;
+        int64_t m_segment_start_usec = 0;       // start of the latest segment (first capture, or the last boundary)
+        int64_t m_latest_usec = 0;
+        std::vector<int64_t> m_boundaries;      // m_boundaries[k] = start of segment k + 1
+    public:
+        SegmentSchedule(const float duration_sec, const int64_t frame_period_usec);
+
+        // Segment index of a capture; timestamps are device timestamps minus the device's subordinate delay
+        uint32_t get_segment(const int64_t timestamp_usec);
+        // Called by a device whose current segment is full
+        void request_split(const uint32_t segment);
+};
+
+// Splits one device's recording into numbered segments created by a factory. The next segment is created (file opened
+// and header written) on a background thread ahead of time, and swapped in between two captures, so every capture is
+// written to exactly one segment. Finished segments are closed on the same thread.
+class SegmentedSink : public RecordingSink {
+    public:
+        using SinkFactory = std::function<std::unique_ptr<RecordingSink>(const uint32_t segment)>;
+    private:
+        SinkFactory m_factory;
+        std::shared_ptr<SegmentSchedule> m_schedule;
+        const int64_t m_timestamp_offset_usec;
+        const uint64_t m_size_limit_bytes;      // 0 = no size limit
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::shared_ptr<RecordingSink> m_current;
+        uint32_t m_current_segment = 0;
+        bool m_split_requested = false;
+        std::unique_ptr<RecordingSink> m_next;  // pre-created segment m_current_segment + 1
+        bool m_next_failed = false;
+        // Segments waiting to be closed, with the bytes they had written when they stopped being current
+        std::deque<std::pair<std::shared_ptr<RecordingSink>, uint64_t>> m_retired;
+        uint64_t m_retired_bytes = 0;           // written to segments other than m_current
+        bool m_stop = false;
+        std::thread m_thread;
+
+        void background_loop();
+    public:
+        // Creates segment 0 on the calling thread (so errors surface as when recording unsegmented)
+        SegmentedSink(SinkFactory factory, std::shared_ptr<SegmentSchedule> schedule, const int64_t timestamp_offset_usec, const uint64_t size_limit_bytes);
+        ~SegmentedSink();
+        SegmentedSink(const SegmentedSink&) = delete;
+        SegmentedSink& operator=(const SegmentedSink&) = delete;
+
+        void write_capture(const k4a::capture& capture) override;
+        // Path of the segment being written
+        std::string get_path() override;
+        // To the segment being written
+        void write_imu_samples(const k4a_imu_sample_t* samples, const size_t count) override;
+        // Across all segments
+        uint64_t get_bytes_written() override;
+};
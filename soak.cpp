@@ -0,0 +1,358 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+#include <k4a/k4a.hpp>
+#include <k4arecord/record.hpp>
+
+#include "BS_thread_pool.hpp"
+#include "SPSCQueue.h"
+
+#include "capture.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+
+// Throughput soak: drives N synthetic devices through the same capture -> pool -> display queue -> recording path
+// as the GUI, with a consumer thread standing in for the render loop, and reports whether the configuration is sustained.
+// Exits with 2 when any device falls short of its frame rate, drops frames or the pool backlog keeps growing.
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void signal_handler(int signal){
+    stop_requested = 1;
+}
+
+static void print_usage(const char* program){
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  -n, --devices <count>          Number of synthetic devices (default: 1)\n"
+              << "  --color-format <name>          Color format (MJPG, NV12, YUY2, BGRA32)\n"
+              << "  --color-resolution <name>      Color resolution (OFF, 720p, ..., 3072p)\n"
+              << "  --depth-mode <name>            Depth mode (OFF, NFOV, WFOV, ...)\n"
+              << "  --fps <5|15|30>                Frame rate\n"
+              << "  -d, --duration <seconds>       Soak duration (default: 300)\n"
+              << "  -s, --stats-interval <seconds> Print interim stats every <seconds> (default: 10)\n"
+              << "  -o, --output <dir>             Record to <dir> (default: no recording)\n"
+              << "  --format <MKV|Spool>           Recording format (default: MKV)\n"
+              << "  --compress-depth               Losslessly compress depth/IR in spool recordings\n"
+              << "  --jpeg-quality <1-100>         Encode uncompressed color to MJPEG at this quality before writing\n"
+              << "  --thumbnails                   Preview thumbnails (overview) instead of full-size images\n"
+              << "  --display-rate <hz>            Rate at which display queues are drained (default: 60)\n"
+              << "  --threads <count>              Thread pool size (default: as in the GUI)\n"
+              << std::flush;
+}
+
+static size_t get_peak_rss_bytes(){
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))){
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    #ifdef __APPLE__
+        return usage.ru_maxrss;
+    #else
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+    #endif
+#endif
+}
+
+// Per-device counters; captures are counted by the capture thread, the rest by pool workers and the display thread
+struct DeviceStats {
+    std::atomic<uint64_t> captures{0};
+    std::atomic<uint64_t> processed{0};
+    std::atomic<uint64_t> displayed{0};
+    // Host arrival of a capture to the end of process_capture (display images queued and capture written)
+    LatencyHistogram capture_to_ready;
+    // Pool-side stages recorded by process_capture
+    DeviceMetrics metrics;
+};
+
+int main(int argc, char* argv[])
+{
+    /***************************************
+     *             ARGUMENTS               *
+     ***************************************/
+
+    int num_devices = 1;
+    double duration_sec = 300.0;
+    double stats_interval_sec = 10.0;
+    double display_rate_hz = 60.0;
+    int num_threads = 0;
+    bool thumbnails = false;
+    std::string output_path;
+    RecordingOptions recording_options;
+    k4a_device_configuration_t config = DEFAULT_CONFIG;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        try {
+            if ((arg == "--color-format") && has_value){
+                config.color_format = static_cast<k4a_image_format_t>(parse_name(COLOR_FORMAT_NAMES, argv[++i]));
+                continue;
+            } else if ((arg == "--color-resolution") && has_value){
+                config.color_resolution = static_cast<k4a_color_resolution_t>(parse_name(COLOR_RESOLUTION_NAMES, argv[++i]));
+                continue;
+            } else if ((arg == "--depth-mode") && has_value){
+                config.depth_mode = static_cast<k4a_depth_mode_t>(parse_name(DEPTH_MODE_NAMES, argv[++i]));
+                continue;
+            } else if ((arg == "--fps") && has_value){
+                config.camera_fps = static_cast<k4a_fps_t>(parse_name(FPS_MODE_NAMES, argv[++i]));
+                continue;
+            } else if ((arg == "--format") && has_value){
+                recording_options.format = static_cast<RecordingFormat>(parse_name(RECORDING_FORMAT_NAMES, argv[++i]));
+                continue;
+            }
+        } catch (std::invalid_argument& e){
+            std::cerr << arg << ": " << e.what() << "\n";
+            return 1;
+        }
+        if ((arg == "-n" || arg == "--devices") && has_value){
+            num_devices = std::atoi(argv[++i]);
+        } else if ((arg == "-d" || arg == "--duration") && has_value){
+            duration_sec = std::atof(argv[++i]);
+        } else if ((arg == "-s" || arg == "--stats-interval") && has_value){
+            stats_interval_sec = std::atof(argv[++i]);
+        } else if ((arg == "-o" || arg == "--output") && has_value){
+            output_path = argv[++i];
+        } else if (arg == "--compress-depth"){
+            recording_options.compress_depth_ir = true;
+        } else if (arg == "--jpeg-quality" && has_value){
+            recording_options.jpeg_encode_color = true;
+            recording_options.jpeg_quality = std::clamp(std::atoi(argv[++i]), 1, 100);
+        } else if (arg == "--thumbnails"){
+            thumbnails = true;
+        } else if ((arg == "--display-rate") && has_value){
+            display_rate_hz = std::atof(argv[++i]);
+        } else if ((arg == "--threads") && has_value){
+            num_threads = std::atoi(argv[++i]);
+        } else if (arg == "-h" || arg == "--help"){
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Unrecognized argument '" << arg << "'\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (num_devices < 1 || duration_sec <= 0 || display_rate_hz <= 0){
+        print_usage(argv[0]);
+        return 1;
+    }
+    const int target_fps = get_fps_value(config.camera_fps);
+    const bool recording_enabled = !output_path.empty();
+
+    /***************************************
+     *               SETUP                 *
+     ***************************************/
+
+    std::vector<std::unique_ptr<CaptureSource>> devices;
+    std::vector<k4a_device_configuration_t> configs(num_devices, config);
+    std::vector<std::string> serials;
+    std::vector<int> device_idxs;
+    for (int i = 0; i < num_devices; i++){
+        devices.push_back(std::make_unique<SyntheticSource>("SOAK-" + std::to_string(i)));
+        serials.push_back(devices.back()->get_serialnum());
+        device_idxs.push_back(i);
+    }
+    std::vector<std::string> nicknames(num_devices);
+
+    // Same pool sizing and display queues as the GUI
+    BS::thread_pool thread_pool(num_threads > 0 ? num_threads : std::max<int>(1, std::min<int>(2 * num_devices, std::thread::hardware_concurrency() - 1)));
+    std::vector<std::shared_ptr<rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>>> color_queues, ir_queues, color_thumb_queues, ir_thumb_queues;
+    for (int i = 0; i < num_devices; i++){
+        color_queues.push_back(std::make_shared<rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>>(IMG_QUEUE_SIZE));
+        ir_queues.push_back(std::make_shared<rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>>(IMG_QUEUE_SIZE));
+        color_thumb_queues.push_back(std::make_shared<rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>>(IMG_QUEUE_SIZE));
+        ir_thumb_queues.push_back(std::make_shared<rigtorp::SPSCQueue<std::shared_ptr<Image<uint8_t>>>>(IMG_QUEUE_SIZE));
+    }
+
+    std::vector<std::unique_ptr<RecordingSink>> recordings;
+    std::vector<bool> recording_write_enables;
+    std::vector<DeviceStats> device_stats(num_devices);
+    std::atomic<bool> running = true;
+    std::vector<std::thread> capture_threads;
+    std::thread display_thread;
+
+    std::signal(SIGINT, signal_handler);
+    std::signal(SIGTERM, signal_handler);
+
+    std::cout << "Soaking " << num_devices << " device(s): " << COLOR_FORMAT_NAMES[config.color_format] << " "
+              << COLOR_RESOLUTION_NAMES[config.color_resolution] << ", " << DEPTH_MODE_NAMES[config.depth_mode] << " @ " << target_fps << " fps, "
+              << thread_pool.get_thread_count() << " pool threads, " << (thumbnails ? "thumbnail" : "full") << " preview, "
+              << (recording_enabled ? "recording " + std::string(RECORDING_FORMAT_EXTENSIONS[recording_options.format]) + " to '" + output_path + "'" : "not recording") << std::endl;
+
+    int return_code = 0;
+    const char* trace_env_path = std::getenv(TRACE_ENV_VAR);
+    if (trace_env_path != nullptr){
+        trace_start();
+    }
+    size_t peak_tasks_queued = 0;
+    std::vector<size_t> interval_tasks_queued;
+    auto start_time = std::chrono::steady_clock::now();
+    try {
+        initialize_recordings(recording_enabled, true, recording_write_enables, recordings, devices, configs, device_idxs, serials, nicknames, output_path, recording_options);
+        start_streaming(devices, configs);
+        start_time = std::chrono::steady_clock::now();
+
+        // Capture threads mirror the GUI's capture loop: a blocking get_capture, then processing on the pool
+        for (int i = 0; i < num_devices; i++){
+            capture_threads.emplace_back([&, i](){
+                trace_set_thread_name("Capture " + std::to_string(i));
+                while (running){
+                    std::shared_ptr<k4a::capture> capture = std::make_shared<k4a::capture>();
+                    try {
+                        devices[i]->get_capture(capture.get(), std::chrono::milliseconds(100));
+                    } catch (k4a::error& e){
+                        print_error_info(e, "Failed to get capture from '" + serials[i] + "'");
+                        stop_requested = 1;
+                        return;
+                    }
+                    if (!capture->is_valid()){
+                        continue;
+                    }
+                    FrameTiming timing;
+                    timing.device_index = i;
+                    timing.arrival = std::chrono::steady_clock::now();
+                    device_stats[i].captures++;
+                    RecordingSink* recording = recording_enabled ? recordings[i].get() : nullptr;
+                    bool write_enable = recording_enabled;
+                    device_stats[i].metrics.tasks_pending.fetch_add(1, std::memory_order_relaxed);
+                    thread_pool.push_task([&, i, capture, timing, recording, write_enable](){
+                        process_capture(capture, configs[i], color_queues[i].get(), ir_queues[i].get(), color_thumb_queues[i].get(), ir_thumb_queues[i].get(),
+                                        !thumbnails, !thumbnails, thumbnails, false, false, recording, write_enable, timing, &device_stats[i].metrics, nullptr);
+                        device_stats[i].capture_to_ready.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - timing.arrival));
+                        device_stats[i].processed++;
+                    });
+                }
+            });
+        }
+
+        // Stand-in for the render loop: drain every display queue at the display rate
+        display_thread = std::thread([&](){
+            const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / display_rate_hz));
+            auto next_frame = std::chrono::steady_clock::now();
+            while (running){
+                for (int i = 0; i < num_devices; i++){
+                    for (auto* queue : {color_queues[i].get(), ir_queues[i].get(), color_thumb_queues[i].get(), ir_thumb_queues[i].get()}){
+                        while (queue->front()){
+                            queue->pop();
+                            device_stats[i].displayed++;
+                        }
+                    }
+                }
+                next_frame += period;
+                std::this_thread::sleep_until(next_frame);
+            }
+        });
+
+        auto last_stats_time = start_time;
+        std::vector<uint64_t> last_captures(num_devices, 0);
+        while (!stop_requested){
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            auto now = std::chrono::steady_clock::now();
+            double elapsed_sec = std::chrono::duration<double>(now - start_time).count();
+            peak_tasks_queued = std::max(peak_tasks_queued, thread_pool.get_tasks_queued());
+            if (elapsed_sec >= duration_sec){
+                break;
+            }
+
+            double interval_sec = std::chrono::duration<double>(now - last_stats_time).count();
+            if (stats_interval_sec > 0 && interval_sec >= stats_interval_sec){
+                size_t tasks_queued = thread_pool.get_tasks_queued();
+                interval_tasks_queued.push_back(tasks_queued);
+                std::cout << std::fixed << std::setprecision(1)
+                          << "[" << elapsed_sec << " s] pool: " << thread_pool.get_tasks_running() << " running, " << tasks_queued << " queued; "
+                          << "peak RSS " << get_peak_rss_bytes() / (1024 * 1024) << " MB\n";
+                for (int i = 0; i < num_devices; i++){
+                    uint64_t captures = device_stats[i].captures;
+                    std::cout << "    " << serials[i] << ": " << (captures - last_captures[i]) / interval_sec << " fps, "
+                              << static_cast<SyntheticSource*>(devices[i].get())->get_dropped_frames() << " dropped, "
+                              << "p99 " << device_stats[i].capture_to_ready.percentile_ms(99) << " ms\n";
+                    last_captures[i] = captures;
+                }
+                std::cout << std::flush;
+                last_stats_time = now;
+            }
+        }
+    } catch (const std::exception& e){
+        print_error_info(e, "Error during soak");
+        return_code = 1;
+    }
+    const double elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    const size_t final_tasks_queued = thread_pool.get_tasks_queued();
+
+    /***************************************
+     *               CLEANUP               *
+     ***************************************/
+
+    running = false;
+    for (std::thread& capture_thread : capture_threads){
+        capture_thread.join();
+    }
+    if (display_thread.joinable()){
+        display_thread.join();
+    }
+    thread_pool.wait_for_tasks();
+    stop_streaming(devices, configs, recordings);
+    if (trace_env_path != nullptr){
+        trace_stop(trace_env_path);
+    }
+    if (return_code != 0){
+        return return_code;
+    }
+
+    /***************************************
+     *               REPORT                *
+     ***************************************/
+
+    // The backlog is growing if it rises across the second half of the run and ends well above one task per device
+    bool backlog_growing = final_tasks_queued > static_cast<size_t>(2 * num_devices);
+    if (interval_tasks_queued.size() >= 4){
+        size_t half = interval_tasks_queued.size() / 2;
+        backlog_growing &= interval_tasks_queued.back() > interval_tasks_queued[half];
+    }
+
+    bool sustained = !backlog_growing;
+    std::cout << "\n" << std::fixed << std::setprecision(2)
+              << "Soak finished after " << elapsed_sec << " s\n"
+              << "    Peak RSS:          " << get_peak_rss_bytes() / (1024 * 1024) << " MB\n"
+              << "    Pool queue:        peak " << peak_tasks_queued << ", final " << final_tasks_queued << (backlog_growing ? " (growing)" : "") << "\n";
+    for (int i = 0; i < num_devices; i++){
+        const DeviceStats& stats = device_stats[i];
+        uint64_t dropped = static_cast<SyntheticSource*>(devices[i].get())->get_dropped_frames();
+        double fps = stats.captures / elapsed_sec;
+        bool device_sustained = fps >= 0.98 * target_fps && dropped <= stats.captures / 1000;
+        sustained &= device_sustained;
+        std::cout << "    " << serials[i] << ": " << fps << " / " << target_fps << " fps, "
+                  << dropped << " dropped, " << stats.processed << " processed, " << stats.displayed << " previewed, "
+                  << "capture-to-ready p50 " << stats.capture_to_ready.percentile_ms(50) << " ms, p99 " << stats.capture_to_ready.percentile_ms(99)
+                  << " ms, max " << stats.capture_to_ready.max_ms() << " ms" << (device_sustained ? "" : " (NOT SUSTAINED)") << "\n";
+        for (LatencyStage stage : {LATENCY_STAGE_POOL_WAIT, LATENCY_STAGE_DECODE, LATENCY_STAGE_QUEUE_PUSH}){
+            const std::array<double, 2> percentiles = stats.metrics.latency.get(stage).percentiles_ms(std::array{50.0, 99.0});
+            std::cout << "        " << std::left << std::setw(12) << LATENCY_STAGE_NAMES[stage] << std::right
+                      << " p50 " << percentiles[0] << " ms, p99 " << percentiles[1] << " ms\n";
+        }
+    }
+    std::cout << (sustained ? "SUSTAINED" : "NOT SUSTAINED") << std::endl;
+
+    return sustained ? 0 : 2;
+}
@@ -0,0 +1,518 @@
+#include <iostream>
+#include <array>
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <malloc.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#include "spool.hpp"
+#include "capture.hpp"
+#include "trace.hpp"
+#include "rvl.hpp"
+
+static size_t round_up(const size_t size, const size_t alignment){
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+/***********************************************************
+ *                       SPOOL SINK                        *
+ ***********************************************************/
+
+AlignedBuffer::~AlignedBuffer(){
+#ifdef _WIN32
+    _aligned_free(m_data);
+#else
+    std::free(m_data);
+#endif
+}
+
+void AlignedBuffer::reserve(const size_t capacity){
+    if (capacity <= m_capacity){
+        return;
+    }
+    size_t size = round_up(capacity, SPOOL_ALIGNMENT);
+#ifdef _WIN32
+    _aligned_free(m_data);
+    m_data = static_cast<uint8_t*>(_aligned_malloc(size, SPOOL_ALIGNMENT));
+#else
+    std::free(m_data);
+    m_data = static_cast<uint8_t*>(std::aligned_alloc(SPOOL_ALIGNMENT, size));
+#endif
+    if (m_data == nullptr){
+        m_capacity = 0;
+        throw std::bad_alloc();
+    }
+    m_capacity = size;
+}
+
+SpoolSink::SpoolSink(const std::string& path, const k4a::device& device, const std::string& serial, const k4a_device_configuration_t& config,
+                     const bool compress_depth_ir) : m_path(path), m_compress_depth_ir(compress_depth_ir){
+    // Unbuffered on Windows: the chunks are already large, so the page cache would only add a copy
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    m_file = handle == INVALID_HANDLE_VALUE ? -1 : reinterpret_cast<int64_t>(handle);
+#else
+    m_file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if (m_file == -1){
+        throw k4a::error("Failed to create spool file '" + path + "'");
+    }
+
+    std::vector<uint8_t> calibration;
+    if (device.is_valid()){
+        calibration = device.get_raw_calibration();
+    }
+    SpoolFileHeader header = {};
+    std::memcpy(header.magic, SPOOL_MAGIC, sizeof(header.magic));
+    header.version = SPOOL_VERSION;
+    header.header_size = round_up(sizeof(header) + calibration.size(), SPOOL_ALIGNMENT);
+    header.color_format = config.color_format;
+    header.color_resolution = config.color_resolution;
+    header.depth_mode = config.depth_mode;
+    header.camera_fps = config.camera_fps;
+    header.synchronized_images_only = config.synchronized_images_only;
+    header.depth_delay_off_color_usec = config.depth_delay_off_color_usec;
+    header.wired_sync_mode = config.wired_sync_mode;
+    header.subordinate_delay_off_master_usec = config.subordinate_delay_off_master_usec;
+    header.disable_streaming_indicator = config.disable_streaming_indicator;
+    std::strncpy(header.serial, serial.c_str(), sizeof(header.serial) - 1);
+    header.calibration_size = calibration.size();
+
+    AlignedBuffer header_buffer;
+    header_buffer.reserve(header.header_size);
+    std::memset(header_buffer.data(), 0, header.header_size);
+    std::memcpy(header_buffer.data(), &header, sizeof(header));
+    if (!calibration.empty()){
+        std::memcpy(header_buffer.data() + sizeof(header), calibration.data(), calibration.size());
+    }
+    if (!write_aligned(header_buffer.data(), header.header_size)){
+#ifdef _WIN32
+        CloseHandle(reinterpret_cast<HANDLE>(m_file));
+#else
+        ::close(m_file);
+#endif
+        throw k4a::error("Failed to write spool header to '" + path + "'");
+    }
+    m_next_offset = header.header_size;
+    m_bytes_written = header.header_size;
+
+    for (int i = 0; i < SPOOL_NUM_CHUNKS; i++){
+        m_chunks.push_back(std::make_unique<Chunk>());
+        m_chunks.back()->buffer.reserve(SPOOL_CHUNK_SIZE);
+        m_free.push_back(m_chunks.back().get());
+    }
+    m_current = m_free.front();
+    m_free.pop_front();
+    m_current->used = sizeof(SpoolChunkHeader);
+    m_current->file_offset = m_next_offset;
+
+    m_writer_thread = std::thread(&SpoolSink::writer_loop, this);
+}
+
+SpoolSink::~SpoolSink(){
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]{ return m_current != nullptr || m_failed; });
+        if (!m_failed && m_current->num_captures > 0){
+            seal_current(lock);
+        }
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_writer_thread.join();
+
+    // Index footer, ending with the trailer so readers can find it from the end of the file
+    if (!m_failed){
+        size_t index_size = round_up(m_index.size() * sizeof(SpoolIndexEntry) + sizeof(SpoolTrailer), SPOOL_ALIGNMENT);
+        AlignedBuffer index_buffer;
+        index_buffer.reserve(index_size);
+        std::memset(index_buffer.data(), 0, index_size);
+        if (!m_index.empty()){
+            std::memcpy(index_buffer.data(), m_index.data(), m_index.size() * sizeof(SpoolIndexEntry));
+        }
+        SpoolTrailer trailer = {m_next_offset, m_index.size(), {}};
+        std::memcpy(trailer.magic, SPOOL_INDEX_MAGIC, sizeof(trailer.magic));
+        std::memcpy(index_buffer.data() + index_size - sizeof(trailer), &trailer, sizeof(trailer));
+        if (!write_aligned(index_buffer.data(), index_size)){
+            std::cerr << "[ERROR] Failed to write the index of spool '" << m_path << "'" << std::endl;
+        }
+    }
+#ifdef _WIN32
+    CloseHandle(reinterpret_cast<HANDLE>(m_file));
+#else
+    ::close(m_file);
+#endif
+}
+
+bool SpoolSink::write_aligned(const uint8_t* data, const size_t size){
+    size_t written = 0;
+    while (written < size){
+#ifdef _WIN32
+        DWORD chunk_written = 0;
+        DWORD to_write = static_cast<DWORD>(std::min<size_t>(size - written, 1 << 30));
+        if (!WriteFile(reinterpret_cast<HANDLE>(m_file), data + written, to_write, &chunk_written, NULL) || chunk_written == 0){
+            return false;
+        }
+#else
+        ssize_t chunk_written = ::write(m_file, data + written, size - written);
+        if (chunk_written <= 0){
+            return false;
+        }
+#endif
+        written += chunk_written;
+    }
+    return true;
+}
+
+void SpoolSink::seal_current(std::unique_lock<std::mutex>& lock){
+    SpoolChunkHeader header = {SPOOL_CHUNK_MAGIC, m_current->num_captures, m_current->used - sizeof(SpoolChunkHeader)};
+    std::memcpy(m_current->buffer.data(), &header, sizeof(header));
+    size_t padded_size = round_up(m_current->used, SPOOL_ALIGNMENT);
+    std::memset(m_current->buffer.data() + m_current->used, 0, padded_size - m_current->used);
+    m_next_offset = m_current->file_offset + padded_size;
+    m_full.push_back(m_current);
+    m_current = nullptr;
+    m_cv.notify_all();
+
+    m_cv.wait(lock, [this]{ return !m_free.empty() || m_failed; });
+    if (m_failed){
+        return;
+    }
+    m_current = m_free.front();
+    m_free.pop_front();
+    m_current->used = sizeof(SpoolChunkHeader);
+    m_current->num_captures = 0;
+    m_current->file_offset = m_next_offset;
+    m_cv.notify_all();
+}
+
+void SpoolSink::writer_loop(){
+    trace_set_thread_name("Spool Writer");
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true){
+        m_cv.wait(lock, [this]{ return m_stop || !m_full.empty(); });
+        if (m_full.empty()){
+            break;
+        }
+        Chunk* chunk = m_full.front();
+        lock.unlock();
+        bool success;
+        {
+            TraceSpan write_span("spool_write");
+            success = write_aligned(chunk->buffer.data(), round_up(chunk->used, SPOOL_ALIGNMENT));
+        }
+        lock.lock();
+        m_full.pop_front();
+        m_free.push_back(chunk);
+        if (!success && !m_failed){
+            std::cerr << "[ERROR] Failed to write to spool '" << m_path << "'; further captures are discarded" << std::endl;
+            m_failed = true;
+        }
+        m_cv.notify_all();
+    }
+}
+
+void SpoolSink::write_capture(const k4a::capture& capture){
+    // Depth/IR compression happens here, outside the lock
+    SpoolCaptureEncoder encoder(capture, m_compress_depth_ir);
+    const size_t size = encoder.get_size();
+
+    // Copying into the chunk is the only work done under the lock
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // Another thread may be waiting in seal_current for the next chunk
+    m_cv.wait(lock, [this]{ return m_current != nullptr || m_failed; });
+    if (m_failed){
+        return;
+    }
+    if (m_current->used + size > m_current->buffer.capacity() && m_current->num_captures > 0){
+        seal_current(lock);
+        if (m_failed){
+            return;
+        }
+    }
+    if (m_current->used + size > m_current->buffer.capacity()){
+        m_current->buffer.reserve(m_current->used + size);
+    }
+
+    m_index.push_back({encoder.get_device_timestamp_usec(), m_current->file_offset + m_current->used});
+    encoder.write(m_current->buffer.data() + m_current->used);
+    m_current->used += size;
+    m_current->num_captures++;
+    m_bytes_written.fetch_add(size, std::memory_order_relaxed);
+}
+
+/***********************************************************
+ *                  CAPTURE SERIALIZATION                  *
+ ***********************************************************/
+
+SpoolCaptureEncoder::SpoolCaptureEncoder(const k4a::capture& capture, const bool compress_depth_ir) : m_images {{
+    {SPOOL_SLOT_COLOR, capture.get_color_image()},
+    {SPOOL_SLOT_DEPTH, capture.get_depth_image()},
+    {SPOOL_SLOT_IR, capture.get_ir_image()}
+}}{
+    m_capture_header = {get_capture_device_timestamp(capture).count(), capture.get_temperature_c(), 0};
+
+    // Compressed depth/IR goes into per-thread buffers, which are reused across captures
+    thread_local std::array<std::vector<uint8_t>, 3> compressed_buffers;
+    m_size = sizeof(SpoolCaptureHeader);
+    for (const auto& [slot, img] : m_images){
+        if (!img.is_valid()){
+            continue;
+        }
+        m_payloads[slot] = img.get_buffer();
+        m_payload_sizes[slot] = img.get_size();
+        m_encodings[slot] = SPOOL_ENCODING_RAW;
+        const bool is_16bit = img.get_format() == K4A_IMAGE_FORMAT_DEPTH16 || img.get_format() == K4A_IMAGE_FORMAT_IR16;
+        if (compress_depth_ir && is_16bit && img.get_size() == static_cast<size_t>(img.get_stride_bytes()) * img.get_height_pixels()){
+            TraceSpan compress_span("rvl_compress");
+            const size_t num_pixels = img.get_size() / sizeof(uint16_t);
+            std::vector<uint8_t>& compressed = compressed_buffers[slot];
+            if (compressed.size() < rvl_max_compressed_size(num_pixels)){
+                compressed.resize(rvl_max_compressed_size(num_pixels));
+            }
+            const size_t compressed_size = rvl_compress(reinterpret_cast<const uint16_t*>(img.get_buffer()), num_pixels, compressed.data());
+            // Noisy frames can come out larger; keep those raw
+            if (compressed_size < img.get_size()){
+                m_payloads[slot] = compressed.data();
+                m_payload_sizes[slot] = compressed_size;
+                m_encodings[slot] = SPOOL_ENCODING_RVL;
+            }
+        }
+        m_size += sizeof(SpoolImageHeader) + round_up(m_payload_sizes[slot], 8);
+        m_capture_header.num_images++;
+    }
+}
+
+void SpoolCaptureEncoder::write(uint8_t* out) const {
+    std::memcpy(out, &m_capture_header, sizeof(m_capture_header));
+    out += sizeof(m_capture_header);
+    for (const auto& [slot, img] : m_images){
+        if (!img.is_valid()){
+            continue;
+        }
+        SpoolImageHeader image_header = {};
+        image_header.slot = slot;
+        image_header.format = img.get_format();
+        image_header.width = img.get_width_pixels();
+        image_header.height = img.get_height_pixels();
+        image_header.stride = img.get_stride_bytes();
+        image_header.white_balance = img.get_white_balance();
+        image_header.iso_speed = img.get_iso_speed();
+        image_header.encoding = m_encodings[slot];
+        image_header.size = m_payload_sizes[slot];
+        image_header.device_timestamp_usec = img.get_device_timestamp().count();
+        image_header.system_timestamp_nsec = img.get_system_timestamp().count();
+        image_header.exposure_usec = img.get_exposure().count();
+        std::memcpy(out, &image_header, sizeof(image_header));
+        out += sizeof(image_header);
+        std::memcpy(out, m_payloads[slot], m_payload_sizes[slot]);
+        std::memset(out + m_payload_sizes[slot], 0, round_up(m_payload_sizes[slot], 8) - m_payload_sizes[slot]);
+        out += round_up(m_payload_sizes[slot], 8);
+    }
+}
+
+static void release_spool_image(void* buffer, void* context){
+    delete[] static_cast<uint8_t*>(buffer);
+}
+
+k4a::image decode_spool_image(const SpoolImageHeader& header, const uint8_t* payload){
+    uint8_t* buffer;
+    size_t buffer_size;
+    if (header.encoding == SPOOL_ENCODING_RVL){
+        buffer_size = static_cast<size_t>(header.stride) * header.height;
+        buffer = new uint8_t[buffer_size];
+        if (!rvl_decompress(payload, header.size, reinterpret_cast<uint16_t*>(buffer), buffer_size / sizeof(uint16_t))){
+            delete[] buffer;
+            throw std::runtime_error("Corrupt compressed image");
+        }
+    } else {
+        buffer_size = header.size;
+        buffer = new uint8_t[buffer_size];
+        std::memcpy(buffer, payload, buffer_size);
+    }
+
+    k4a::image img = k4a::image::create_from_buffer(static_cast<k4a_image_format_t>(header.format), header.width, header.height,
+        header.stride, buffer, buffer_size, release_spool_image, nullptr);
+    img.set_timestamp(std::chrono::microseconds(header.device_timestamp_usec));
+    img.set_system_timestamp(std::chrono::nanoseconds(header.system_timestamp_nsec));
+    img.set_exposure_time(std::chrono::microseconds(header.exposure_usec));
+    img.set_white_balance(header.white_balance);
+    img.set_iso_speed(header.iso_speed);
+    return img;
+}
+
+static void set_spool_image(k4a::capture& capture, const uint32_t slot, const k4a::image& img){
+    if (slot == SPOOL_SLOT_COLOR){
+        capture.set_color_image(img);
+    } else if (slot == SPOOL_SLOT_DEPTH){
+        capture.set_depth_image(img);
+    } else {
+        capture.set_ir_image(img);
+    }
+}
+
+k4a::capture decode_spool_capture(const uint8_t* data, const size_t size){
+    const uint8_t* end = data + size;
+    SpoolCaptureHeader capture_header;
+    if (size < sizeof(capture_header)){
+        throw std::runtime_error("Truncated capture");
+    }
+    std::memcpy(&capture_header, data, sizeof(capture_header));
+    data += sizeof(capture_header);
+    k4a::capture capture = k4a::capture::create();
+    for (uint32_t i = 0; i < capture_header.num_images; i++){
+        SpoolImageHeader image_header;
+        if (static_cast<size_t>(end - data) < sizeof(image_header)){
+            throw std::runtime_error("Truncated capture");
+        }
+        std::memcpy(&image_header, data, sizeof(image_header));
+        data += sizeof(image_header);
+        if (static_cast<size_t>(end - data) < image_header.size){
+            throw std::runtime_error("Truncated capture");
+        }
+        set_spool_image(capture, image_header.slot, decode_spool_image(image_header, data));
+        data += std::min(round_up(image_header.size, 8), static_cast<size_t>(end - data));
+    }
+    capture.set_temperature_c(capture_header.temperature_c);
+    return capture;
+}
+
+/***********************************************************
+ *                       SPOOL READER                      *
+ ***********************************************************/
+
+SpoolReader::SpoolReader(const std::string& path) : m_path(path), m_file(path, std::ios::binary){
+    if (!m_file.read(reinterpret_cast<char*>(&m_header), sizeof(m_header)) || std::memcmp(m_header.magic, SPOOL_MAGIC, sizeof(SPOOL_MAGIC)) != 0){
+        throw std::runtime_error("'" + path + "' is not a spool file");
+    }
+    if (m_header.version != SPOOL_VERSION){
+        throw std::runtime_error("Spool '" + path + "' has unsupported version " + std::to_string(m_header.version));
+    }
+    m_calibration.resize(m_header.calibration_size);
+    if (!m_calibration.empty() && !m_file.read(reinterpret_cast<char*>(m_calibration.data()), m_calibration.size())){
+        throw std::runtime_error("Spool '" + path + "' is truncated");
+    }
+}
+
+k4a_device_configuration_t SpoolReader::get_device_configuration() const {
+    k4a_device_configuration_t config = DEFAULT_CONFIG;
+    config.color_format = static_cast<k4a_image_format_t>(m_header.color_format);
+    config.color_resolution = static_cast<k4a_color_resolution_t>(m_header.color_resolution);
+    config.depth_mode = static_cast<k4a_depth_mode_t>(m_header.depth_mode);
+    config.camera_fps = static_cast<k4a_fps_t>(m_header.camera_fps);
+    config.synchronized_images_only = m_header.synchronized_images_only;
+    config.depth_delay_off_color_usec = m_header.depth_delay_off_color_usec;
+    config.wired_sync_mode = static_cast<k4a_wired_sync_mode_t>(m_header.wired_sync_mode);
+    config.subordinate_delay_off_master_usec = m_header.subordinate_delay_off_master_usec;
+    config.disable_streaming_indicator = m_header.disable_streaming_indicator;
+    return config;
+}
+
+std::vector<SpoolIndexEntry> SpoolReader::read_index(){
+    std::vector<SpoolIndexEntry> index;
+    std::ifstream file(m_path, std::ios::binary);
+    SpoolTrailer trailer;
+    file.seekg(-static_cast<std::streamoff>(sizeof(trailer)), std::ios::end);
+    if (!file.read(reinterpret_cast<char*>(&trailer), sizeof(trailer)) || std::memcmp(trailer.magic, SPOOL_INDEX_MAGIC, sizeof(SPOOL_INDEX_MAGIC)) != 0){
+        return index;
+    }
+    index.resize(trailer.num_entries);
+    file.seekg(trailer.index_offset);
+    if (!index.empty() && !file.read(reinterpret_cast<char*>(index.data()), index.size() * sizeof(SpoolIndexEntry))){
+        index.clear();
+    }
+    return index;
+}
+
+std::vector<SpoolIndexEntry> SpoolReader::scan_index(){
+    std::vector<SpoolIndexEntry> index;
+    std::ifstream file(m_path, std::ios::binary);
+    file.seekg(0, std::ios::end);
+    const uint64_t file_size = file.tellg();
+    uint64_t chunk_offset = m_header.header_size;
+    while (true){
+        file.seekg(chunk_offset);
+        SpoolChunkHeader chunk_header;
+        if (!file.read(reinterpret_cast<char*>(&chunk_header), sizeof(chunk_header)) || chunk_header.magic != SPOOL_CHUNK_MAGIC){
+            return index;
+        }
+        const uint64_t chunk_end = static_cast<uint64_t>(file.tellg()) + chunk_header.size;
+        for (uint32_t c = 0; c < chunk_header.num_captures; c++){
+            const uint64_t offset = file.tellg();
+            SpoolCaptureHeader capture_header;
+            if (!file.read(reinterpret_cast<char*>(&capture_header), sizeof(capture_header))){
+                return index;
+            }
+            // Payloads are skipped, but must be in the file
+            for (uint32_t i = 0; i < capture_header.num_images; i++){
+                SpoolImageHeader image_header;
+                if (!file.read(reinterpret_cast<char*>(&image_header), sizeof(image_header)) || static_cast<uint64_t>(file.tellg()) + image_header.size > file_size){
+                    return index;
+                }
+                file.seekg(round_up(image_header.size, 8), std::ios::cur);
+            }
+            index.push_back({capture_header.device_timestamp_usec, offset});
+        }
+        chunk_offset = round_up(chunk_end, SPOOL_ALIGNMENT);
+    }
+}
+
+bool SpoolReader::get_next_capture(k4a::capture* capture){
+    while (m_chunk_remaining == 0){
+        m_file.seekg(m_chunk_end == 0 ? m_header.header_size : round_up(m_chunk_end, SPOOL_ALIGNMENT));
+        SpoolChunkHeader chunk_header;
+        if (!m_file.read(reinterpret_cast<char*>(&chunk_header), sizeof(chunk_header)) || chunk_header.magic != SPOOL_CHUNK_MAGIC){
+            return false;
+        }
+        m_chunk_remaining = chunk_header.num_captures;
+        m_chunk_end = static_cast<uint64_t>(m_file.tellg()) + chunk_header.size;
+    }
+
+    if (!read_capture(capture)){
+        return false;
+    }
+    m_chunk_remaining--;
+    return true;
+}
+
+bool SpoolReader::get_capture_at(const uint64_t offset, k4a::capture* capture){
+    m_file.clear();
+    m_file.seekg(offset);
+    return read_capture(capture);
+}
+
+bool SpoolReader::read_capture(k4a::capture* capture){
+    SpoolCaptureHeader capture_header;
+    if (!m_file.read(reinterpret_cast<char*>(&capture_header), sizeof(capture_header))){
+        return false;
+    }
+    k4a::capture result = k4a::capture::create();
+    for (uint32_t i = 0; i < capture_header.num_images; i++){
+        SpoolImageHeader image_header;
+        if (!m_file.read(reinterpret_cast<char*>(&image_header), sizeof(image_header))){
+            return false;
+        }
+        m_payload.resize(image_header.size);
+        if (!m_file.read(reinterpret_cast<char*>(m_payload.data()), image_header.size)){
+            return false;
+        }
+        m_file.seekg(round_up(image_header.size, 8) - image_header.size, std::ios::cur);
+        try {
+            set_spool_image(result, image_header.slot, decode_spool_image(image_header, m_payload.data()));
+        } catch (const std::runtime_error& e){
+            throw std::runtime_error("Spool '" + m_path + "': " + e.what());
+        }
+    }
+    result.set_temperature_c(capture_header.temperature_c);
+    *capture = std::move(result);
+    return true;
+}
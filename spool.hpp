@@ -0,0 +1,236 @@
+#pragma once
+
+#include <string>
+#include <array>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+
+#include <k4a/k4a.hpp>
+
+#include "recording_sink.hpp"
+
+// File offsets and write sizes are multiples of this (covers 512-byte and 4K sectors for unbuffered I/O)
+#define SPOOL_ALIGNMENT 4096
+// Captures are batched into chunks of about this size; a chunk grows to fit a larger capture
+#define SPOOL_CHUNK_SIZE (16 << 20)
+// Chunk buffers per spool; capture threads wait for a free one if the disk falls this far behind
+#define SPOOL_NUM_CHUNKS 4
+#define SPOOL_VERSION 1
+
+/***********************************************************
+ *                       SPOOL FORMAT                      *
+ ***********************************************************/
+
+// Layout (little-endian, all sections padded to SPOOL_ALIGNMENT):
+//   SpoolFileHeader, raw calibration blob
+//   chunks: SpoolChunkHeader, then per capture a SpoolCaptureHeader and per image a SpoolImageHeader + payload
+//   index: SpoolIndexEntry per capture, with the SpoolTrailer as the last bytes of the file
+// A spool whose writer crashed has no index but can still be read chunk by chunk.
+
+static const char SPOOL_MAGIC[8] = {'K', '4', 'A', 'S', 'P', 'O', 'O', 'L'};
+static const char SPOOL_INDEX_MAGIC[8] = {'K', '4', 'A', 'I', 'N', 'D', 'E', 'X'};
+static const uint32_t SPOOL_CHUNK_MAGIC = 0x4b4e4843; // "CHNK"
+
+struct SpoolFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;           // offset of the first chunk
+    int32_t color_format;
+    int32_t color_resolution;
+    int32_t depth_mode;
+    int32_t camera_fps;
+    int32_t synchronized_images_only;
+    int32_t depth_delay_off_color_usec;
+    int32_t wired_sync_mode;
+    uint32_t subordinate_delay_off_master_usec;
+    int32_t disable_streaming_indicator;
+    char serial[32];
+    uint64_t calibration_size;      // raw calibration JSON follows the header
+};
+
+struct SpoolChunkHeader {
+    uint32_t magic;
+    uint32_t num_captures;
+    uint64_t size;                  // bytes of captures after this header (the chunk is then padded)
+};
+
+struct SpoolCaptureHeader {
+    int64_t device_timestamp_usec;
+    float temperature_c;
+    uint32_t num_images;
+};
+
+enum SpoolImageSlot {
+    SPOOL_SLOT_COLOR = 0,
+    SPOOL_SLOT_DEPTH,
+    SPOOL_SLOT_IR
+};
+
+enum SpoolImageEncoding {
+    SPOOL_ENCODING_RAW = 0,
+    SPOOL_ENCODING_RVL              // 16-bit depth/IR compressed with rvl_compress; decodes to stride * height bytes
+};
+
+struct SpoolImageHeader {
+    uint32_t slot;
+    int32_t format;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    uint32_t white_balance;
+    uint32_t iso_speed;
+    uint32_t encoding;
+    uint64_t size;                  // payload bytes as stored (padded to 8 in the file)
+    int64_t device_timestamp_usec;
+    int64_t system_timestamp_nsec;
+    int64_t exposure_usec;
+};
+
+struct SpoolIndexEntry {
+    int64_t device_timestamp_usec;
+    uint64_t offset;                // file offset of the SpoolCaptureHeader
+};
+
+struct SpoolTrailer {
+    uint64_t index_offset;
+    uint64_t num_entries;
+    char magic[8];
+};
+
+/***********************************************************
+ *                  CAPTURE SERIALIZATION                  *
+ ***********************************************************/
+
+// One capture in the layout used inside spool chunks (SpoolCaptureHeader, then a SpoolImageHeader + payload per image).
+// Compressed payloads live in per-thread buffers, so write() must be called before the thread encodes another capture.
+class SpoolCaptureEncoder {
+    private:
+        std::array<std::pair<SpoolImageSlot, k4a::image>, 3> m_images;
+        std::array<const uint8_t*, 3> m_payloads = {};
+        std::array<size_t, 3> m_payload_sizes = {};
+        std::array<SpoolImageEncoding, 3> m_encodings = {};
+        SpoolCaptureHeader m_capture_header;
+        size_t m_size;
+    public:
+        SpoolCaptureEncoder(const k4a::capture& capture, const bool compress_depth_ir);
+
+        size_t get_size() const { return m_size; }
+        int64_t get_device_timestamp_usec() const { return m_capture_header.device_timestamp_usec; }
+        // Writes get_size() bytes
+        void write(uint8_t* out) const;
+};
+
+// Decoders for the layout above; the images own copies of their buffers. Throw std::runtime_error on corrupt data.
+k4a::image decode_spool_image(const SpoolImageHeader& header, const uint8_t* payload);
+k4a::capture decode_spool_capture(const uint8_t* data, const size_t size);
+
+/***********************************************************
+ *                       SPOOL SINK                        *
+ ***********************************************************/
+
+// Heap buffer aligned to SPOOL_ALIGNMENT, as unbuffered writes require
+class AlignedBuffer {
+    private:
+        uint8_t* m_data = nullptr;
+        size_t m_capacity = 0;
+    public:
+        AlignedBuffer(){}
+        ~AlignedBuffer();
+        AlignedBuffer(const AlignedBuffer&) = delete;
+        AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+        // Grows (discarding the contents) to at least the given size, rounded up to SPOOL_ALIGNMENT
+        void reserve(const size_t capacity);
+        uint8_t* data(){ return m_data; }
+        size_t capacity() const { return m_capacity; }
+};
+
+// Appends each capture's raw payloads (MJPEG/NV12/YUY2/BGRA bytes, 16-bit depth/IR) and metadata to a chunked,
+// append-only file. Capture threads only copy into the current chunk; a writer thread writes full chunks
+// sequentially with large aligned writes (unbuffered on Windows). Convert to .mkv offline with spool2mkv.
+// With compress_depth_ir, depth and IR are RVL-compressed on the calling thread before the copy.
+class SpoolSink : public RecordingSink {
+    private:
+        struct Chunk {
+            AlignedBuffer buffer;
+            size_t used = 0;
+            uint32_t num_captures = 0;
+            uint64_t file_offset = 0;
+        };
+
+        std::string m_path;
+        int64_t m_file = -1;                    // native handle (fd or HANDLE)
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::vector<std::unique_ptr<Chunk>> m_chunks;
+        Chunk* m_current = nullptr;
+        std::deque<Chunk*> m_free;
+        std::deque<Chunk*> m_full;
+        uint64_t m_next_offset = 0;             // file offset of the next chunk to be started
+        std::vector<SpoolIndexEntry> m_index;
+        bool m_compress_depth_ir;
+        bool m_stop = false;
+        bool m_failed = false;
+        std::atomic<uint64_t> m_bytes_written = 0;  // header and captures copied into chunks
+        std::thread m_writer_thread;
+
+        // Hands the current chunk to the writer and waits for a free one; called with m_mutex held
+        void seal_current(std::unique_lock<std::mutex>& lock);
+        void writer_loop();
+        bool write_aligned(const uint8_t* data, const size_t size);
+    public:
+        SpoolSink(const std::string& path, const k4a::device& device, const std::string& serial, const k4a_device_configuration_t& config,
+                  const bool compress_depth_ir = false);
+        // Writes the remaining chunks and the index
+        ~SpoolSink();
+        SpoolSink(const SpoolSink&) = delete;
+        SpoolSink& operator=(const SpoolSink&) = delete;
+
+        void write_capture(const k4a::capture& capture) override;
+        std::string get_path() override { return m_path; }
+        // Encoded (RVL-compressed) sizes, counted as captures join a chunk, so the total tracks the file's size
+        uint64_t get_bytes_written() override { return m_bytes_written.load(std::memory_order_relaxed); }
+};
+
+/***********************************************************
+ *                       SPOOL READER                      *
+ ***********************************************************/
+
+// Reads a spool back in capture order, for conversion and inspection
+class SpoolReader {
+    private:
+        std::string m_path;
+        std::ifstream m_file;
+        SpoolFileHeader m_header;
+        std::vector<uint8_t> m_calibration;
+        std::vector<uint8_t> m_payload;             // reused read buffer
+        uint64_t m_chunk_end = 0;
+        uint32_t m_chunk_remaining = 0;
+
+        // Reads one capture at the current file position
+        bool read_capture(k4a::capture* capture);
+    public:
+        // Throws std::runtime_error if the file is not a spool
+        SpoolReader(const std::string& path);
+
+        k4a_device_configuration_t get_device_configuration() const;
+        std::string get_serialnum() const { return std::string(m_header.serial, strnlen(m_header.serial, sizeof(m_header.serial))); }
+        const std::vector<uint8_t>& get_raw_calibration() const { return m_calibration; }
+        // Entries of the index footer; empty if the spool was not closed cleanly
+        std::vector<SpoolIndexEntry> read_index();
+        // The same entries rebuilt by walking the chunks, for the readable part of a spool without an index
+        std::vector<SpoolIndexEntry> scan_index();
+
+        // Returns false at the end of the spool (or of its readable part); throws std::runtime_error on a corrupt image
+        bool get_next_capture(k4a::capture* capture);
+        // Reads the capture at an index entry's offset; returns false if it is truncated. Not to be mixed with get_next_capture
+        bool get_capture_at(const uint64_t offset, k4a::capture* capture);
+};
@@ -0,0 +1,111 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+
+#include <k4a/k4a.hpp>
+#include <k4arecord/record.hpp>
+
+#include "capture.hpp"
+#include "spool.hpp"
+
+// Offline converter from the raw spool recording format to .mkv files readable by k4arecord/k4aviewer
+// The device configuration, serial number and calibration stored in the spool header are written as the usual tags
+// and calibration attachment, so the result matches a recording made directly to .mkv
+
+static void print_usage(const char* program){
+    std::cerr << "Usage: " << program << " <input.spool>... [-o <output.mkv or dir>]\n"
+              << "  -o, --output <path>   Output file (single input) or directory (default: next to each input)\n"
+              << std::flush;
+}
+
+static bool convert_spool(const std::string& input_path, const std::string& output_path){
+    auto start_time = std::chrono::steady_clock::now();
+    SpoolReader reader(input_path);
+    std::vector<SpoolIndexEntry> index = reader.read_index();
+    if (index.empty()){
+        std::cout << "Note: '" << input_path << "' has no index (recording was interrupted); converting its readable captures" << std::endl;
+        index = reader.scan_index();
+    }
+    // Pool threads finish captures out of order, so file order can go back in time; .mkv timestamps must not
+    std::stable_sort(index.begin(), index.end(), [](const SpoolIndexEntry& a, const SpoolIndexEntry& b){ return a.device_timestamp_usec < b.device_timestamp_usec; });
+
+    // A null device leaves out the calibration and serial, which are added from the spool instead
+    k4a::record recording = k4a::record::create(output_path.c_str(), k4a::device(), reader.get_device_configuration());
+    const std::vector<uint8_t>& calibration = reader.get_raw_calibration();
+    if (!calibration.empty()){
+        recording.add_attachment("calibration.json", calibration.data(), calibration.size());
+        recording.add_tag("K4A_CALIBRATION_FILE", "calibration.json");
+    }
+    if (!reader.get_serialnum().empty()){
+        recording.add_tag("K4A_DEVICE_SERIAL_NUMBER", reader.get_serialnum().c_str());
+    }
+    recording.write_header();
+
+    uint64_t num_captures = 0;
+    k4a::capture capture;
+    for (const SpoolIndexEntry& entry : index){
+        if (!reader.get_capture_at(entry.offset, &capture)){
+            break;
+        }
+        recording.write_capture(capture);
+        num_captures++;
+    }
+    recording.flush();
+    recording.close();
+
+    double elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    std::cout << input_path << " -> " << output_path << ": " << num_captures << " captures in " << elapsed_sec << " s" << std::endl;
+    if (num_captures != index.size()){
+        std::cerr << "[ERROR] Index lists " << index.size() << " captures, but " << num_captures << " were read" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> input_paths;
+    std::string output_path;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if ((arg == "-o" || arg == "--output") && i + 1 < argc){
+            output_path = argv[++i];
+        } else if (arg == "-h" || arg == "--help"){
+            print_usage(argv[0]);
+            return 0;
+        } else if (arg[0] != '-'){
+            input_paths.push_back(arg);
+        } else {
+            std::cerr << "Unrecognized argument '" << arg << "'\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (input_paths.empty()){
+        print_usage(argv[0]);
+        return 1;
+    }
+    const bool output_is_dir = !output_path.empty() && (input_paths.size() > 1 || std::filesystem::is_directory(output_path));
+
+    int return_code = 0;
+    for (const std::string& input_path : input_paths){
+        std::filesystem::path mkv_path = std::filesystem::path(input_path).replace_extension(".mkv");
+        if (output_is_dir){
+            mkv_path = std::filesystem::path(output_path) / mkv_path.filename();
+        } else if (!output_path.empty()){
+            mkv_path = output_path;
+        }
+        try {
+            if (!convert_spool(input_path, mkv_path.string())){
+                return_code = 1;
+            }
+        } catch (const std::exception& e){
+            print_error_info(e, "Failed to convert '" + input_path + "'");
+            return_code = 1;
+        }
+    }
+    return return_code;
+}
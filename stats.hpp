@@ -0,0 +1,137 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Latency histogram resolution and range; slower samples land in the last (overflow) bucket
+#define LATENCY_HISTOGRAM_BUCKET_USEC 50
+#define LATENCY_HISTOGRAM_BUCKETS 10000
+
+// Fixed-size latency histogram that any number of threads can record into without locking
+// Percentiles are read from the live counters, so they are approximate while samples are still being added
+class LatencyHistogram {
+    private:
+        std::array<std::atomic<uint32_t>, LATENCY_HISTOGRAM_BUCKETS> m_buckets{};
+        std::atomic<uint64_t> m_count{0};
+        std::atomic<int64_t> m_max_usec{0};
+        std::atomic<int64_t> m_sum_usec{0};
+    public:
+        void record(const std::chrono::microseconds latency){
+            int64_t usec = latency.count() < 0 ? 0 : latency.count();
+            int64_t bucket = usec / LATENCY_HISTOGRAM_BUCKET_USEC;
+            m_buckets[bucket < LATENCY_HISTOGRAM_BUCKETS ? bucket : LATENCY_HISTOGRAM_BUCKETS - 1].fetch_add(1, std::memory_order_relaxed);
+            m_count.fetch_add(1, std::memory_order_relaxed);
+            m_sum_usec.fetch_add(usec, std::memory_order_relaxed);
+            int64_t max_usec = m_max_usec.load(std::memory_order_relaxed);
+            while (usec > max_usec && !m_max_usec.compare_exchange_weak(max_usec, usec, std::memory_order_relaxed)){}
+        }
+
+        uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+        double max_ms() const { return m_max_usec.load(std::memory_order_relaxed) / 1000.0; }
+        double sum_ms() const { return m_sum_usec.load(std::memory_order_relaxed) / 1000.0; }
+
+        // Upper edges of the buckets containing the given percentiles (0-100, ascending), in milliseconds; 0 when empty
+        // Found in one pass over the buckets, so asking for several costs the same as one. Percentiles in the overflow
+        // bucket (or beyond what the live buckets add up to yet) report the maximum instead
+        template <size_t N>
+        std::array<double, N> percentiles_ms(const std::array<double, N>& percentiles) const {
+            std::array<double, N> result{};
+            uint64_t total = count();
+            if (total == 0){
+                return result;
+            }
+            size_t p = 0;
+            uint64_t seen = 0;
+            for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS - 1 && p < N; i++){
+                seen += m_buckets[i].load(std::memory_order_relaxed);
+                while (p < N && seen > static_cast<uint64_t>(total * percentiles[p] / 100.0)){
+                    result[p++] = (i + 1) * LATENCY_HISTOGRAM_BUCKET_USEC / 1000.0;
+                }
+            }
+            for (; p < N; p++){
+                result[p] = max_ms();
+            }
+            return result;
+        }
+        double percentile_ms(const double percentile) const { return percentiles_ms(std::array{percentile})[0]; }
+
+        void reset(){
+            for (std::atomic<uint32_t>& bucket : m_buckets){
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            m_count.store(0, std::memory_order_relaxed);
+            m_max_usec.store(0, std::memory_order_relaxed);
+            m_sum_usec.store(0, std::memory_order_relaxed);
+        }
+};
+
+// Pipeline stages timed for each capture; each spans the time since the previous stage's timestamp
+enum LatencyStage {
+    LATENCY_STAGE_SDK_QUEUE,    // host system timestamp -> returned by get_capture
+    LATENCY_STAGE_POOL_WAIT,    // arrival -> processing task started
+    LATENCY_STAGE_DECODE,       // task start -> decoded/scaled (and flipped)
+    LATENCY_STAGE_QUEUE_PUSH,   // decoded -> pushed to the display queue (includes thumbnailing)
+    LATENCY_STAGE_DISPLAY_WAIT, // queued -> popped by the render loop
+    LATENCY_STAGE_UPLOAD,       // popped -> texture upload issued
+    LATENCY_STAGE_PRESENT,      // uploaded -> buffers swapped
+    LATENCY_STAGE_TOTAL,        // arrival -> buffers swapped
+    NUM_LATENCY_STAGES
+};
+static const std::array LATENCY_STAGE_NAMES {"SDK queue", "Pool wait", "Decode", "Queue push", "Display wait", "Upload", "Present", "Total"};
+
+// Timestamps carried with a capture's display images through the pipeline
+struct FrameTiming {
+    int device_index = -1;
+    uint64_t sequence = 0;                          // from DeviceMetrics::record_capture
+    std::chrono::microseconds device_timestamp{0};
+    std::chrono::steady_clock::time_point arrival;
+    std::chrono::steady_clock::time_point task_start;
+    std::chrono::steady_clock::time_point decode_done;
+    std::chrono::steady_clock::time_point queued;
+    std::chrono::steady_clock::time_point popped;
+    std::chrono::steady_clock::time_point uploaded;
+};
+
+// One latency histogram per stage for a single device; recorded from the capture loop, pool workers and render loop
+class StageLatencyStats {
+    private:
+        std::array<LatencyHistogram, NUM_LATENCY_STAGES> m_histograms;
+    public:
+        void record(const LatencyStage stage, const std::chrono::steady_clock::time_point from, const std::chrono::steady_clock::time_point to){
+            m_histograms[stage].record(std::chrono::duration_cast<std::chrono::microseconds>(to - from));
+        }
+        const LatencyHistogram& get(const LatencyStage stage) const { return m_histograms[stage]; }
+        void reset(){
+            for (LatencyHistogram& histogram : m_histograms){
+                histogram.reset();
+            }
+        }
+};
+
+// Per-device health counters, cheap enough to keep updated at all times
+struct DeviceMetrics {
+    std::atomic<uint64_t> captures{0};
+    std::atomic<uint64_t> dropped_frames{0};  // inferred from gaps in device timestamps
+    std::atomic<uint64_t> preview_drops{0};   // display images discarded because the display queue was full
+    std::atomic<uint64_t> bytes_written{0};   // bytes the recording has written to its files
+    std::atomic<int64_t> tasks_pending{0};    // incremented when queuing process_capture, decremented when it finishes
+    StageLatencyStats latency;
+
+    // Called by the device's capture loop for every capture; returns the capture's sequence number
+    uint64_t record_capture(const std::chrono::microseconds device_timestamp, const std::chrono::microseconds frame_period){
+        const uint64_t sequence = captures.fetch_add(1, std::memory_order_relaxed);
+        if (m_last_device_timestamp.count() >= 0 && frame_period.count() > 0){
+            int64_t gap = (device_timestamp - m_last_device_timestamp).count();
+            if (2 * gap > 3 * frame_period.count()){
+                dropped_frames.fetch_add((gap + frame_period.count() / 2) / frame_period.count() - 1, std::memory_order_relaxed);
+            }
+        }
+        m_last_device_timestamp = device_timestamp;
+        return sequence;
+    }
+
+    private:
+        std::chrono::microseconds m_last_device_timestamp{-1}; // capture loop only
+};
@@ -0,0 +1,62 @@
+#include <algorithm>
+
+#include "timelapse.hpp"
+#include "capture.hpp"
+
+TimelapseSchedule::TimelapseSchedule(const int64_t interval_usec, const int64_t frame_period_usec)
+    : m_interval_usec(interval_usec), m_half_frame_usec(frame_period_usec / 2){}
+
+int64_t TimelapseSchedule::get_tick(const int64_t timestamp_usec){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_started){
+        m_started = true;
+        m_tick_usec = timestamp_usec;
+    } else if (timestamp_usec >= m_tick_usec + m_interval_usec - m_half_frame_usec){
+        m_tick++;
+        m_tick_usec = timestamp_usec;
+    }
+    // Devices behind the first one still find the tick's capture; one that dropped it skips the tick
+    if (timestamp_usec > m_tick_usec - m_half_frame_usec && timestamp_usec < m_tick_usec + m_half_frame_usec){
+        return m_tick;
+    }
+    return -1;
+}
+
+bool TimelapseFilter::is_due(const std::chrono::microseconds device_timestamp){
+    int64_t tick = m_schedule->get_tick(device_timestamp.count() - m_timestamp_offset_usec);
+    if (tick < 0 || tick == m_last_tick){
+        return false;
+    }
+    m_last_tick = tick;
+    return true;
+}
+
+void initialize_timelapses(
+    std::vector<std::unique_ptr<TimelapseFilter>>& timelapses,
+    const std::vector<k4a_device_configuration_t>& configs,
+    const RecordingOptions& recording_options
+){
+    timelapses.clear();
+    if (recording_options.timelapse_mode == TIMELAPSE_MODE_OFF){
+        return;
+    }
+    std::shared_ptr<TimelapseSchedule> sync_schedule;
+    for (const k4a_device_configuration_t& config : configs){
+        const int fps = get_fps_value(config.camera_fps);
+        const int64_t frame_period_usec = 1000000 / fps;
+        // Every N frames is expressed in time too, so that ticks land between frames whatever the timestamp jitter
+        const int64_t interval_usec = recording_options.timelapse_mode == TIMELAPSE_MODE_FRAMES
+            ? std::max(recording_options.timelapse_frames, 1) * 1000000LL / fps
+            : std::max(static_cast<int64_t>(recording_options.timelapse_sec * 1e6), frame_period_usec);
+        std::shared_ptr<TimelapseSchedule> schedule;
+        if (config.wired_sync_mode == K4A_WIRED_SYNC_MODE_STANDALONE){
+            schedule = std::make_shared<TimelapseSchedule>(interval_usec, frame_period_usec);
+        } else {
+            if (sync_schedule == nullptr){
+                sync_schedule = std::make_shared<TimelapseSchedule>(interval_usec, frame_period_usec);
+            }
+            schedule = sync_schedule;
+        }
+        timelapses.push_back(std::make_unique<TimelapseFilter>(schedule, get_sync_timestamp_offset_usec(config)));
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+#include <k4a/k4a.hpp>
+
+#include "recording_sink.hpp"
+
+/***********************************************************
+ *                  TIME-LAPSE RECORDING                   *
+ ***********************************************************/
+
+// Picks the captures a time-lapse recording keeps, in device time. The first device to reach a tick (an interval after
+// the previous tick's capture) fixes that tick's capture; every device sharing the schedule keeps its own capture within
+// half a frame of it, so wired-sync devices (with subordinate delays removed) keep the same frames. Each tick is
+// anchored to an actual capture, so rounding and clock drift do not accumulate.
+class TimelapseSchedule {
+    private:
+        std::mutex m_mutex;
+        const int64_t m_interval_usec;
+        const int64_t m_half_frame_usec;
+        bool m_started = false;
+        int64_t m_tick = 0;
+        int64_t m_tick_usec = 0;                // timestamp of the latest tick's capture
+    public:
+        TimelapseSchedule(const int64_t interval_usec, const int64_t frame_period_usec);
+
+        // Tick whose capture this is, or -1; timestamps are device timestamps minus the device's subordinate delay
+        int64_t get_tick(const int64_t timestamp_usec);
+};
+
+// One device's view of a (possibly shared) schedule
+class TimelapseFilter {
+    private:
+        std::shared_ptr<TimelapseSchedule> m_schedule;
+        const int64_t m_timestamp_offset_usec;
+        int64_t m_last_tick = -1;
+    public:
+        TimelapseFilter(std::shared_ptr<TimelapseSchedule> schedule, const int64_t timestamp_offset_usec)
+            : m_schedule(std::move(schedule)), m_timestamp_offset_usec(timestamp_offset_usec) {}
+
+        // Whether to record this capture; called once per capture, in order, from the device's capture thread
+        bool is_due(const std::chrono::microseconds device_timestamp);
+};
+
+// One filter per device (empty when time-lapse is off); wired-sync devices share a schedule
+void initialize_timelapses(
+    std::vector<std::unique_ptr<TimelapseFilter>>& timelapses,
+    const std::vector<k4a_device_configuration_t>& configs,
+    const RecordingOptions& recording_options
+);
@@ -0,0 +1,164 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include "trace.hpp"
+
+std::atomic<uint32_t> trace_active_session{0};
+
+struct TraceEvent {
+    const char* name;
+    int device;
+    int64_t start_ns; // steady_clock time since its epoch
+    int64_t duration_ns;
+};
+
+// Written only by the thread that owns it; the writer resets it when it first records into a new session,
+// and the exporter reads the events published by the count's release store
+struct TraceBuffer {
+    std::unique_ptr<TraceEvent[]> events;
+    std::atomic<uint32_t> session{0};
+    std::atomic<size_t> count{0};
+    std::atomic<uint64_t> dropped{0};
+    std::string thread_name;
+    bool in_use = false;
+};
+
+// Buffers outlive their threads and are handed to new threads once released, so pool restarts do not keep growing memory
+static std::mutex trace_registry_mutex;
+static std::vector<std::unique_ptr<TraceBuffer>> trace_buffers;
+static uint32_t trace_last_session = 0;
+static std::chrono::steady_clock::time_point trace_start_time;
+
+struct TraceThreadState {
+    TraceBuffer* buffer = nullptr;
+    std::string name;
+    ~TraceThreadState(){
+        if (buffer != nullptr){
+            std::lock_guard<std::mutex> lock(trace_registry_mutex);
+            buffer->in_use = false;
+        }
+    }
+};
+static thread_local TraceThreadState trace_thread_state;
+
+static TraceBuffer* get_thread_trace_buffer(){
+    if (trace_thread_state.buffer == nullptr){
+        std::lock_guard<std::mutex> lock(trace_registry_mutex);
+        // A released buffer holding events of the running trace stays reserved so each track is one thread
+        uint32_t session = trace_active_session.load(std::memory_order_relaxed);
+        for (std::unique_ptr<TraceBuffer>& buffer : trace_buffers){
+            if (!buffer->in_use && buffer->session.load(std::memory_order_relaxed) != session){
+                trace_thread_state.buffer = buffer.get();
+                break;
+            }
+        }
+        if (trace_thread_state.buffer == nullptr){
+            trace_buffers.push_back(std::make_unique<TraceBuffer>());
+            trace_buffers.back()->events = std::unique_ptr<TraceEvent[]>(new TraceEvent[TRACE_BUFFER_EVENTS]);
+            trace_thread_state.buffer = trace_buffers.back().get();
+        }
+        trace_thread_state.buffer->in_use = true;
+        trace_thread_state.buffer->thread_name = trace_thread_state.name;
+    }
+    return trace_thread_state.buffer;
+}
+
+void trace_start(){
+    std::lock_guard<std::mutex> lock(trace_registry_mutex);
+    if (trace_enabled()){
+        return;
+    }
+    trace_start_time = std::chrono::steady_clock::now();
+    trace_active_session.store(++trace_last_session, std::memory_order_release);
+    std::cout << "Tracing started" << std::endl;
+}
+
+bool trace_stop(const std::string& output_path){
+    uint32_t session = trace_active_session.exchange(0);
+    if (session == 0){
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(trace_registry_mutex);
+    std::ofstream out(output_path);
+    if (!out){
+        std::cerr << "[ERROR] Could not open trace file '" << output_path << "' for writing" << std::endl;
+        return false;
+    }
+    const int64_t start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(trace_start_time.time_since_epoch()).count();
+    size_t num_events = 0;
+    uint64_t num_dropped = 0;
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Azure Kinect Controller\"}}";
+    for (int t = 0; t < trace_buffers.size(); t++){
+        TraceBuffer& buffer = *trace_buffers[t];
+        if (buffer.session.load(std::memory_order_acquire) != session){
+            continue;
+        }
+        const int tid = t + 1;
+        const std::string thread_name = buffer.thread_name.empty() ? "Thread " + std::to_string(tid) : buffer.thread_name;
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":\"" << thread_name << "\"}}";
+
+        size_t count = buffer.count.load(std::memory_order_acquire);
+        for (size_t e = 0; e < count; e++){
+            const TraceEvent& event = buffer.events[e];
+            out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+                << ",\"ts\":" << (event.start_ns - start_ns) / 1000.0 << ",\"dur\":" << event.duration_ns / 1000.0;
+            if (event.device >= 0){
+                out << ",\"args\":{\"device\":" << event.device << "}";
+            }
+            out << "}";
+        }
+        num_events += count;
+        num_dropped += buffer.dropped.load(std::memory_order_relaxed);
+    }
+    out << "\n]}\n";
+    out.close();
+
+    std::cout << "Tracing stopped; wrote " << num_events << " events to '" << output_path << "'";
+    if (num_dropped > 0){
+        std::cout << " (" << num_dropped << " dropped: per-thread buffers full)";
+    }
+    std::cout << std::endl;
+    return !out.fail();
+}
+
+void trace_set_thread_name(const std::string& name){
+    trace_thread_state.name = name;
+    if (trace_thread_state.buffer != nullptr){
+        std::lock_guard<std::mutex> lock(trace_registry_mutex);
+        trace_thread_state.buffer->thread_name = name;
+    }
+}
+
+void trace_record(const char* name, const int device, const std::chrono::steady_clock::time_point start, const std::chrono::steady_clock::time_point end){
+    uint32_t session = trace_active_session.load(std::memory_order_acquire);
+    if (session == 0){
+        return;
+    }
+    TraceBuffer* buffer = get_thread_trace_buffer();
+    if (buffer->session.load(std::memory_order_relaxed) != session){
+        buffer->count.store(0, std::memory_order_relaxed);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+        buffer->session.store(session, std::memory_order_release);
+    }
+
+    size_t idx = buffer->count.load(std::memory_order_relaxed);
+    if (idx >= TRACE_BUFFER_EVENTS){
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer->events[idx] = {
+        name,
+        device,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count(),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()
+    };
+    buffer->count.store(idx + 1, std::memory_order_release);
+}
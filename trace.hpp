@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Events kept per thread per trace; later events on a full thread are dropped (and counted)
+#define TRACE_BUFFER_EVENTS (1 << 18)
+// When set, tracing starts at launch and the trace is written to this path on exit
+#define TRACE_ENV_VAR "KINECT_CONTROLLER_TRACE"
+
+/***********************************************************
+ *                         TRACING                         *
+ ***********************************************************/
+
+// Spans are recorded into per-thread buffers without locks and written out as Chrome trace-event JSON
+// (chrome://tracing or https://ui.perfetto.dev). When tracing is off a span costs one relaxed atomic load.
+
+extern std::atomic<uint32_t> trace_active_session; // 0 when tracing is off
+
+inline bool trace_enabled(){ return trace_active_session.load(std::memory_order_relaxed) != 0; }
+void trace_start();
+// Stop tracing and write everything recorded since trace_start; returns false if the file could not be written
+bool trace_stop(const std::string& output_path);
+// Label the calling thread in the trace (e.g. "Render", "Capture 0")
+void trace_set_thread_name(const std::string& name);
+// Record a completed span; name must be a string literal (or otherwise outlive the trace)
+void trace_record(const char* name, const int device, const std::chrono::steady_clock::time_point start, const std::chrono::steady_clock::time_point end);
+
+// Records the enclosing scope as a span; device < 0 leaves it unattributed
+class TraceSpan {
+    private:
+        const char* m_name;
+        int m_device;
+        uint32_t m_session;
+        std::chrono::steady_clock::time_point m_start;
+    public:
+        TraceSpan(const char* name, const int device = -1) : m_name(name), m_device(device), m_session(trace_active_session.load(std::memory_order_relaxed)){
+            if (m_session != 0){
+                m_start = std::chrono::steady_clock::now();
+            }
+        }
+        ~TraceSpan(){
+            // Spans that straddle a start/stop belong to neither trace
+            if (m_session != 0 && m_session == trace_active_session.load(std::memory_order_relaxed)){
+                trace_record(m_name, m_device, m_start, std::chrono::steady_clock::now());
+            }
+        }
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+};